@@ -0,0 +1,154 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "coalesce.h"
+#include "util.h"
+
+/* Pending motion is flushed at the latest this many seconds after the
+   first coalesced frame when only the frame limit is in use. Otherwise
+   motion at the end of a movement could wait forever for the Nth
+   frame. */
+static const double FRAMES_FLUSH_TIMEOUT = 0.01;
+
+/* Rate is the maximum number of motion reports per second and frames
+   the number of motion-only input frames merged into one report. Zero
+   disables the corresponding limit. */
+void coalesce_init(struct coalesce *coalesce, double rate, unsigned frames)
+{
+        memset(coalesce, 0, sizeof(struct coalesce));
+        coalesce->interval = rate > 0 ? 1.0 / rate : 0;
+        coalesce->frames = frames > 1 ? frames : 0;
+        coalesce->is_motion_only = 1;
+}
+
+int coalesce_is_enabled(const struct coalesce *coalesce)
+{
+        return coalesce->interval > 0 || coalesce->frames > 0;
+}
+
+static int flush(struct coalesce *coalesce, const struct timeval *time,
+                 struct input_event *outv)
+{
+        int outc = 0;
+        int code;
+
+        if (!coalesce->pending)
+                return 0;
+
+        for (code = 0; coalesce->pending; ++code) {
+                if (!(coalesce->pending & (1 << code)))
+                        continue;
+                coalesce->pending &= ~(1 << code);
+                if (coalesce->sumv[code] == 0)
+                        continue;
+                outv[outc].time = *time;
+                outv[outc].type = EV_REL;
+                outv[outc].code = code;
+                outv[outc].value = coalesce->sumv[code];
+                coalesce->sumv[code] = 0;
+                ++outc;
+        }
+        coalesce->framec = 0;
+        coalesce->last_report = timestamp(time);
+        return outc;
+}
+
+static int is_report_due(const struct coalesce *coalesce, double now)
+{
+        if (coalesce->frames && coalesce->framec < coalesce->frames)
+                return 0;
+        if (coalesce->interval
+            && now - coalesce->last_report < coalesce->interval)
+                return 0;
+        return 1;
+}
+
+/* Copies eventc events from eventv to outv, summing relative motion of
+   consecutive motion-only frames. outv must have room for eventc +
+   COALESCE_FLUSH_MAX events. Motion is never dropped: any other event
+   flushes the pending sums before itself, so that e.g. a click lands
+   where the pointer was moved to.
+
+   Returns the number of events copied to outv. */
+int coalesce_events(struct coalesce *coalesce,
+                    const struct input_event *eventv, int eventc,
+                    struct input_event *outv)
+{
+        int outc = 0;
+        int i;
+
+        for (i = 0; i < eventc; ++i) {
+                const struct input_event *event = &eventv[i];
+
+                if (event->type == EV_REL && event->code < REL_CNT) {
+                        if (!coalesce->pending)
+                                coalesce->first_pending =
+                                        timestamp(&event->time);
+                        coalesce->sumv[event->code] += event->value;
+                        coalesce->pending |= 1 << event->code;
+                        continue;
+                }
+
+                if (event->type == EV_SYN && event->code == SYN_REPORT
+                    && coalesce->is_motion_only) {
+                        ++coalesce->framec;
+                        if (!is_report_due(coalesce,
+                                           timestamp(&event->time)))
+                                continue;
+                }
+
+                outc += flush(coalesce, &event->time, &outv[outc]);
+                outv[outc++] = *event;
+                coalesce->is_motion_only = event->type == EV_SYN;
+        }
+        return outc;
+}
+
+/* Returns the time by which pending motion has to be flushed with
+   coalesce_flush(), or 0 if there is nothing pending. */
+double coalesce_deadline(const struct coalesce *coalesce)
+{
+        double deadline = 0;
+
+        if (!coalesce->pending)
+                return 0;
+        if (coalesce->interval)
+                deadline = coalesce->last_report + coalesce->interval;
+        if (coalesce->frames
+            && (!deadline
+                || coalesce->first_pending + FRAMES_FLUSH_TIMEOUT < deadline))
+                deadline = coalesce->first_pending + FRAMES_FLUSH_TIMEOUT;
+        return deadline;
+}
+
+/* Reports pending motion followed by SYN_REPORT. outv must have room
+   for COALESCE_FLUSH_MAX events. Returns the number of events copied to
+   outv. */
+int coalesce_flush(struct coalesce *coalesce, const struct timeval *now,
+                   struct input_event *outv)
+{
+        int outc;
+
+        if ((outc = flush(coalesce, now, outv)) == 0)
+                return 0;
+        outv[outc].time = *now;
+        outv[outc].type = EV_SYN;
+        outv[outc].code = SYN_REPORT;
+        outv[outc].value = 0;
+        return outc + 1;
+}
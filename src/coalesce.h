@@ -0,0 +1,51 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <linux/input.h>
+#include <stdint.h>
+
+/* Maximum number of events coalesce_flush() produces: one per relative
+   axis and a SYN_REPORT. */
+#define COALESCE_FLUSH_MAX (REL_CNT + 1)
+
+struct coalesce {
+        double   interval;
+        unsigned frames;
+        int32_t  sumv[REL_CNT];
+        uint32_t pending;
+        unsigned framec;
+        int      is_motion_only;
+        double   last_report;
+        double   first_pending;
+};
+
+void coalesce_init(struct coalesce *coalesce, double rate, unsigned frames);
+
+int coalesce_is_enabled(const struct coalesce *coalesce);
+
+int coalesce_events(struct coalesce *coalesce,
+                    const struct input_event *eventv, int eventc,
+                    struct input_event *outv);
+
+double coalesce_deadline(const struct coalesce *coalesce);
+
+int coalesce_flush(struct coalesce *coalesce, const struct timeval *now,
+                   struct input_event *outv);
+
+#endif /* COALESCE_H */
@@ -0,0 +1,478 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE /* accept4 */
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <linux/input.h>
+
+#include "control.h"
+#include "settings.h"
+#include "util.h"
+
+static int    listen_fd = -1;
+static char   listen_path[sizeof(struct sockaddr_un)];
+static int    client_fdv[CONTROL_CLIENTS_MAX];
+static int  (*apply_settings)(void);
+static int  (*select_preset)(const char *name);
+static const char *(*get_preset_name)(int preset_i, int *is_active);
+static const char *(*get_stat)(int stat_i, double *value);
+static char   request[4096];
+static char   reply[CONTROL_MESSAGE_MAX];
+static size_t reply_len;
+
+/* Starts listening for clients at socket_path. Only the owner of the
+   daemon may connect, because clients can change the configuration.
+   Saved settings are put into effect by calling apply, which returns 0
+   if they were applied, 1 if they require a restart and -1 on error.
+   Presets are made active by calling select, which returns -1 if there
+   is no such preset, and listed by calling name with increasing
+   indices until it returns NULL. Statistics are listed by calling stat
+   the same way.
+
+   Returns
+
+   0 : The socket is listening.
+
+   -1 : Syscall failed and errno is set: all resources were released.
+*/
+int control_open(const char *socket_path, int (*apply)(void),
+                 int (*select)(const char *name),
+                 const char *(*name)(int preset_i, int *is_active),
+                 const char *(*stat)(int stat_i, double *value))
+{
+        struct sockaddr_un addr;
+        int orig_errno;
+        int i;
+
+        for (i = 0; i < CONTROL_CLIENTS_MAX; ++i)
+                client_fdv[i] = -1;
+        apply_settings = apply;
+        select_preset = select;
+        get_preset_name = name;
+        get_stat = stat;
+
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+
+        if ((listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC
+                                | SOCK_NONBLOCK, 0)) == -1)
+                goto err;
+
+        memset(&addr, 0, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        /* A stale socket of a previous instance. */
+        unlink(socket_path);
+
+        if (bind(listen_fd, (struct sockaddr *) &addr,
+                 sizeof(struct sockaddr_un)) == -1)
+                goto err;
+        strcpy(listen_path, socket_path);
+
+        if (chmod(socket_path, S_IRUSR | S_IWUSR) == -1)
+                goto err;
+
+        if (listen(listen_fd, CONTROL_CLIENTS_MAX) == -1)
+                goto err;
+
+        return 0;
+err:
+        orig_errno = errno;
+        control_close();
+        errno = orig_errno;
+        return -1;
+}
+
+void control_close(void)
+{
+        int i;
+
+        /* Clients exist only while listening. */
+        if (listen_fd == -1)
+                return;
+        for (i = 0; i < CONTROL_CLIENTS_MAX; ++i) {
+                if (client_fdv[i] != -1)
+                        close(client_fdv[i]);
+                client_fdv[i] = -1;
+        }
+        close(listen_fd);
+        if (*listen_path)
+                unlink(listen_path);
+        *listen_path = '\0';
+        listen_fd = -1;
+}
+
+int control_is_open(void)
+{
+        return listen_fd != -1;
+}
+
+int control_listen_fd(void)
+{
+        return listen_fd;
+}
+
+int control_client_fd(int client_i)
+{
+        return client_fdv[client_i];
+}
+
+/* Accepts a pending client.
+
+   Returns
+
+   >=0 : Index of the new client.
+
+   -1 : Syscall failed or there is no room for more clients, errno is
+   set. The connection was closed.
+*/
+int control_accept(void)
+{
+        int sock_fd;
+        int i;
+
+        if ((sock_fd = accept4(listen_fd, NULL, NULL,
+                               SOCK_CLOEXEC | SOCK_NONBLOCK)) == -1)
+                return -1;
+
+        for (i = 0; i < CONTROL_CLIENTS_MAX; ++i) {
+                if (client_fdv[i] == -1)
+                        break;
+        }
+        if (i == CONTROL_CLIENTS_MAX) {
+                close(sock_fd);
+                errno = EMFILE;
+                return -1;
+        }
+
+        client_fdv[i] = sock_fd;
+        return i;
+}
+
+/* Appends formatted text to the reply. Returns -1 if it does not
+   fit. */
+static int append(const char *format, ...)
+{
+        va_list ap;
+        int     len;
+
+        va_start(ap, format);
+        len = vsnprintf(reply + reply_len, sizeof(reply) - reply_len, format,
+                        ap);
+        va_end(ap);
+        if (len < 0 || len >= sizeof(reply) - reply_len)
+                return -1;
+        reply_len += len;
+        return 0;
+}
+
+static void reply_error(const char *reason)
+{
+        reply_len = 0;
+        append("error %s\n", reason);
+}
+
+/* Appends a catalog line of the event device at path, if it can be
+   opened. Devices unplugged while listing are skipped. */
+static int append_device(const char *path)
+{
+        struct input_id id;
+        char            name[256];
+        uint8_t         typev[EV_MAX / 8 + 1];
+        unsigned long   types = 0;
+        char           *c;
+        int             retval = 0;
+        int             fd;
+        int             i;
+
+        if ((fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) == -1)
+                return 0;
+
+        memset(name, 0, sizeof(name));
+        memset(typev, 0, sizeof(typev));
+        if (ioctl(fd, EVIOCGID, &id) == -1
+            || ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) == -1
+            || ioctl(fd, EVIOCGBIT(0, sizeof(typev)), typev) == -1)
+                goto out;
+
+        /* The reply is line based. */
+        for (c = name; *c != '\0'; ++c) {
+                if (*c == '\n')
+                        *c = ' ';
+        }
+        for (i = 0; i < EV_CNT && i < sizeof(types) * 8; ++i) {
+                if (bit_test8(i, typev))
+                        types |= 1UL << i;
+        }
+
+        retval = append("%s %u %u %u %u %lx %s\n", strrchr(path, '/') + 1,
+                        id.bustype, id.vendor, id.product, id.version, types,
+                        name);
+out:
+        close(fd);
+        return retval;
+}
+
+static void handle_devices(void)
+{
+        const char *devroot_path;
+        char        pattern[_POSIX_PATH_MAX + 1];
+        glob_t      g;
+        size_t      i;
+
+        if ((devroot_path = get_devroot_path()) == NULL) {
+                reply_error(strerror(errno));
+                return;
+        }
+        if (snprintf(pattern, sizeof(pattern), "%s/input/event*",
+                     devroot_path) >= sizeof(pattern)) {
+                reply_error(strerror(ENAMETOOLONG));
+                return;
+        }
+
+        switch (glob(pattern, GLOB_ERR, NULL, &g)) {
+        case 0:
+                break;
+        case GLOB_NOMATCH:
+                return;
+        default:
+                reply_error(strerror(errno));
+                return;
+        }
+
+        for (i = 0; i < g.gl_pathc; ++i) {
+                if (append_device(g.gl_pathv[i]) == -1) {
+                        reply_error("too many devices");
+                        break;
+                }
+        }
+        globfree(&g);
+}
+
+static void handle_codes(char *node, const char *type_name)
+{
+        const char *devroot_path;
+        char        path[_POSIX_PATH_MAX + 1];
+        uint8_t     bits[KEY_MAX / 8 + 1];
+        int         type;
+        int         max;
+        const char *sep = "";
+        int         code;
+        int         fd;
+
+        if (type_name != NULL && strcmp(type_name, "key") == 0) {
+                type = EV_KEY;
+                max = KEY_MAX;
+        } else if (type_name != NULL && strcmp(type_name, "rel") == 0) {
+                type = EV_REL;
+                max = REL_MAX;
+        } else {
+                reply_error("unknown event type");
+                return;
+        }
+
+        /* Only event devices, not arbitrary paths. */
+        if (node == NULL || strncmp(node, "event", 5) || node[5] == '\0'
+            || strspn(node + 5, "0123456789") != strlen(node + 5)) {
+                reply_error("no such device");
+                return;
+        }
+
+        if ((devroot_path = get_devroot_path()) == NULL) {
+                reply_error(strerror(errno));
+                return;
+        }
+        if (snprintf(path, sizeof(path), "%s/input/%s", devroot_path,
+                     node) >= sizeof(path)) {
+                reply_error(strerror(ENAMETOOLONG));
+                return;
+        }
+
+        if ((fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) == -1) {
+                reply_error(strerror(errno));
+                return;
+        }
+        memset(bits, 0, sizeof(bits));
+        if (ioctl(fd, EVIOCGBIT(type, max / 8 + 1), bits) == -1) {
+                reply_error(strerror(errno));
+                close(fd);
+                return;
+        }
+        close(fd);
+
+        for (code = 0; code <= max; ++code) {
+                if (!bit_test8(code, bits))
+                        continue;
+                append("%s%d", sep, code);
+                sep = " ";
+        }
+        append("\n");
+}
+
+static void handle_get(const char *name)
+{
+        char value[sizeof(request)];
+        int  retval;
+
+        if (name == NULL) {
+                reply_error("missing setting name");
+                return;
+        }
+
+        switch ((retval = settings_read_entry(name, value, sizeof(value)))) {
+        case 0:
+                append("%s\n", value);
+                break;
+        case -1:
+                reply_error(strerror(errno));
+                break;
+        default:
+                reply_error(settings_strerror(retval));
+                break;
+        }
+}
+
+static void handle_set(const char *name, const char *value)
+{
+        int retval;
+
+        if (name == NULL) {
+                reply_error("missing setting name");
+                return;
+        }
+
+        switch ((retval = settings_write_entry(name,
+                                               value ? value : ""))) {
+        case 0:
+                break;
+        case -1:
+                reply_error(strerror(errno));
+                return;
+        default:
+                reply_error(settings_strerror(retval));
+                return;
+        }
+
+        switch (apply_settings()) {
+        case 0:
+                break;
+        case 1:
+                reply_len = 0;
+                append("ok restart\n");
+                break;
+        default:
+                reply_error("saved, but could not be applied");
+                break;
+        }
+}
+
+static void handle_preset(const char *name)
+{
+        const char *preset_name;
+        int         is_active;
+        int         i;
+
+        if (name != NULL && select_preset(name) == -1) {
+                reply_error("no such preset");
+                return;
+        }
+
+        for (i = 0; (preset_name = get_preset_name(i, &is_active)) != NULL;
+             ++i)
+                append(is_active ? "%s active\n" : "%s\n", preset_name);
+}
+
+static void handle_stats(void)
+{
+        const char *name;
+        double      value;
+        int         i;
+
+        for (i = 0; (name = get_stat(i, &value)) != NULL; ++i)
+                append("%s %g\n", name, value);
+}
+
+/* Handles a readable client socket: answers one request, or drops the
+   client if it went away or misbehaved.
+
+   Returns 1 if the client is still connected, 0 if it was dropped. */
+int control_handle_client(int client_i)
+{
+        ssize_t bytes;
+        char   *command;
+        char   *arg;
+        char   *value = NULL;
+
+        bytes = recv(client_fdv[client_i], request, sizeof(request) - 1,
+                     MSG_DONTWAIT | MSG_TRUNC);
+        if (bytes == -1 && errno == EAGAIN)
+                return 1;
+        if (bytes <= 0 || bytes >= sizeof(request))
+                goto drop;
+        request[bytes] = '\0';
+        if (bytes && request[bytes - 1] == '\n')
+                request[bytes - 1] = '\0';
+
+        command = request;
+        if ((arg = strchr(command, ' ')) != NULL) {
+                *arg++ = '\0';
+                if ((value = strchr(arg, ' ')) != NULL)
+                        *value++ = '\0';
+        }
+
+        reply_len = 0;
+        append("ok\n");
+        if (strcmp(command, "devices") == 0)
+                handle_devices();
+        else if (strcmp(command, "codes") == 0)
+                handle_codes(arg, value);
+        else if (strcmp(command, "get") == 0)
+                handle_get(arg);
+        else if (strcmp(command, "set") == 0)
+                handle_set(arg, value);
+        else if (strcmp(command, "preset") == 0)
+                handle_preset(arg);
+        else if (strcmp(command, "stats") == 0)
+                handle_stats();
+        else
+                reply_error("unknown request");
+
+        /* Clients wait for the reply, so a full socket buffer means a
+           client which is not reading. */
+        if (send(client_fdv[client_i], reply, reply_len,
+                 MSG_DONTWAIT | MSG_NOSIGNAL) != reply_len)
+                goto drop;
+        return 1;
+drop:
+        close(client_fdv[client_i]);
+        client_fdv[client_i] = -1;
+        return 0;
+}
@@ -0,0 +1,73 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CONTROL_H
+#define CONTROL_H
+
+/* Local control socket for administration tools.
+
+   A client connects to a SOCK_SEQPACKET socket and sends requests, one
+   per message. Every request gets a single reply message whose first
+   line is `ok', `ok restart' if a change was saved but takes effect
+   only when evdaemon is restarted, or `error REASON'. The result
+   follows on the next lines:
+
+   devices           One line per event device:
+                     NODE BUSTYPE VENDOR PRODUCT VERSION TYPES NAME
+                     where the ids are decimal and TYPES is the bitmask
+                     of supported event types in hex, e.g.
+                     `event3 17 1 1 43841 120013 AT keyboard'.
+
+   codes NODE TYPE   Space separated decimal codes of TYPE, `key' or
+                     `rel', supported by device NODE, e.g. `event3'.
+
+   get NAME          Value of setting NAME as written in the
+                     configuration, e.g. `get filter/duration'.
+
+   set NAME VALUE    Validates and saves VALUE as the value of setting
+                     NAME. Changes which do not require reopening the
+                     devices are applied at once.
+
+   preset [NAME]     Makes preset NAME active, if given. One line per
+                     compiled preset follows, the active one being
+                     followed by ` active', e.g. `gaming active'.
+
+   stats             One line per resource use statistic, NAME VALUE,
+                     e.g. `resident_kb 1436' or `fds 9', sampled now.
+                     A watchdog or soak test polls it to catch leaks,
+                     and latency drift in `latency_us_mean'. */
+
+#define CONTROL_CLIENTS_MAX 4
+#define CONTROL_MESSAGE_MAX 65536
+
+int control_open(const char *socket_path, int (*apply)(void),
+                 int (*select_preset)(const char *name),
+                 const char *(*preset_name)(int preset_i, int *is_active),
+                 const char *(*stat)(int stat_i, double *value));
+
+void control_close(void);
+
+int control_is_open(void);
+
+int control_listen_fd(void);
+
+int control_client_fd(int client_i);
+
+int control_accept(void);
+
+int control_handle_client(int client_i);
+
+#endif /* CONTROL_H */
@@ -0,0 +1,142 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "debounce.h"
+#include "util.h"
+
+void debounce_init(struct debounce *debounce, double window)
+{
+        memset(debounce, 0, sizeof(struct debounce));
+        debounce->window = window;
+}
+
+/* Returns the index of the held release of code, or -1. */
+static int find_held(const struct debounce *debounce, int code)
+{
+        int i;
+
+        for (i = 0; i < debounce->heldc; ++i) {
+                if (debounce->heldv[i].code == code)
+                        return i;
+        }
+        return -1;
+}
+
+static void remove_held(struct debounce *debounce, int held_i)
+{
+        --debounce->heldc;
+        memmove(&debounce->heldv[held_i], &debounce->heldv[held_i + 1],
+                (debounce->heldc - held_i) * sizeof(struct input_event));
+}
+
+/* Decides whether event is a bounce. Presses are dropped within the
+   window after a release of the same code, the repeats and the release
+   of a dropped press are dropped too, so that no key is left pressed. A
+   dropped release restarts the window, which keeps a switch chattering
+   for long from typing more than once. Releases within the window after
+   a press are held, debounce_release() passes them on once the window
+   has passed, unless a press of the same code drops them before.
+
+   Releases held back must be passed on by debounce_release() before
+   events read after their window are decided, so that a late press is
+   not taken for a bounce.
+
+   Returns
+
+   DEBOUNCE_PASS : event is not a bounce.
+
+   DEBOUNCE_DROP : event is a bounce to be dropped.
+
+   DEBOUNCE_HOLD : event is a release kept by debounce.
+*/
+int debounce_event(struct debounce *debounce, const struct input_event *event)
+{
+        double time;
+        int    held_i;
+
+        if (event->type != EV_KEY || event->code >= KEY_CNT)
+                return DEBOUNCE_PASS;
+
+        time = timestamp(&event->time);
+        switch (event->value) {
+        case 1:
+                /* The switch closed again: the key never went up. */
+                if ((held_i = find_held(debounce, event->code)) != -1) {
+                        remove_held(debounce, held_i);
+                        ++debounce->droppedc;
+                        return DEBOUNCE_DROP;
+                }
+                if (time - debounce->release_timev[event->code]
+                    >= debounce->window) {
+                        debounce->press_timev[event->code] = time;
+                        return DEBOUNCE_PASS;
+                }
+                debounce->droppedv[event->code / 64] |=
+                        (uint64_t) 1 << (event->code % 64);
+                ++debounce->droppedc;
+                return DEBOUNCE_DROP;
+        case 0:
+                debounce->release_timev[event->code] = time;
+                if (bit_test64(event->code, debounce->droppedv)) {
+                        debounce->droppedv[event->code / 64] &=
+                                ~((uint64_t) 1 << (event->code % 64));
+                        return DEBOUNCE_DROP;
+                }
+                /* A release which cannot be held passes as it is. */
+                if (time - debounce->press_timev[event->code]
+                    >= debounce->window
+                    || debounce->heldc == DEBOUNCE_HELD_MAX)
+                        return DEBOUNCE_PASS;
+                debounce->heldv[debounce->heldc++] = *event;
+                return DEBOUNCE_HOLD;
+        default:
+                return bit_test64(event->code, debounce->droppedv)
+                        ? DEBOUNCE_DROP : DEBOUNCE_PASS;
+        }
+}
+
+/* Copies the held releases whose window has passed by now to eventv,
+   which must have room for DEBOUNCE_HELD_MAX events, oldest first.
+   Returns the number of events copied. */
+int debounce_release(struct debounce *debounce, double now,
+                     struct input_event *eventv)
+{
+        int releasec;
+
+        for (releasec = 0; releasec < debounce->heldc; ++releasec) {
+                const struct input_event *event =
+                        &debounce->heldv[releasec];
+
+                if (timestamp(&event->time) + debounce->window > now)
+                        break;
+                eventv[releasec] = *event;
+        }
+        debounce->heldc -= releasec;
+        memmove(debounce->heldv, &debounce->heldv[releasec],
+                debounce->heldc * sizeof(struct input_event));
+        return releasec;
+}
+
+/* Returns the time the oldest held release is due, or 0 if none is
+   held. */
+double debounce_deadline(const struct debounce *debounce)
+{
+        if (!debounce->heldc)
+                return 0;
+        return timestamp(&debounce->heldv[0].time) + debounce->window;
+}
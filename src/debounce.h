@@ -0,0 +1,66 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <linux/input.h>
+#include <stdint.h>
+
+#define DEBOUNCE_HELD_MAX 8
+
+#define DEBOUNCE_PASS 0
+#define DEBOUNCE_DROP 1
+#define DEBOUNCE_HOLD 2
+
+/* Chatter of worn key and button switches: a press within window
+   seconds of the release of the same code is taken as a bounce and
+   dropped together with its release, so that a bouncing switch types
+   once. A release within window seconds of the press of the same code
+   is held back until the window has passed, and dropped together with
+   the press ending it if the switch closes again before, so that a
+   held key or a drag is not released early. */
+struct debounce {
+        double             window;
+        double             press_timev[KEY_CNT];
+        double             release_timev[KEY_CNT];
+        uint64_t           droppedv[KEY_CNT / 64 + 1]; /* Press was dropped. */
+        struct input_event heldv[DEBOUNCE_HELD_MAX]; /* Oldest first. */
+        int                heldc;
+        unsigned long      droppedc;
+};
+
+void debounce_init(struct debounce *debounce, double window);
+
+static inline int debounce_is_enabled(const struct debounce *debounce)
+{
+        return debounce->window > 0;
+}
+
+static inline int debounce_is_holding(const struct debounce *debounce)
+{
+        return debounce->heldc;
+}
+
+int debounce_event(struct debounce *debounce,
+                   const struct input_event *event);
+
+int debounce_release(struct debounce *debounce, double now,
+                     struct input_event *eventv);
+
+double debounce_deadline(const struct debounce *debounce);
+
+#endif /* DEBOUNCE_H */
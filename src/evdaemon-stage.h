@@ -0,0 +1,112 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef EVDAEMON_STAGE_H
+#define EVDAEMON_STAGE_H
+
+/* Interface of evdaemon filter stages.
+
+   A stage is a shared object exporting a constant struct evdaemon_stage
+   named evdaemon_stage. Stages listed in filter/stages are loaded when
+   evdaemon starts and chained in that order into the forward path of the
+   pipeline, between suppression and motion coalescing: every batch of
+   events evdaemon is about to write to the clone device passes through
+   each stage in turn.
+
+     #include <evdaemon-stage.h>
+
+     static void process(void *state, struct evdaemon_stage_batch *batch)
+     {
+             uint32_t i;
+
+             for (i = 0; i < batch->eventc; ++i)
+                     rewrite batch->eventv[i] in place
+     }
+
+     const struct evdaemon_stage evdaemon_stage = {
+             .abi_version = EVDAEMON_STAGE_ABI_VERSION,
+             .name        = "example",
+             .process     = process,
+     };
+
+   Stages run in the event loop of evdaemon and every microsecond they
+   take delays the events of the pipeline. Hence the contract:
+
+   - Memory is allocated in init() only. process() and expire() work on
+     the batch in place and on the state made by init(): they do not
+     allocate, block, sleep or make system calls which could.
+
+   - Events are handled a batch at a time. A batch holds the events of
+     one wakeup and is not necessarily a whole frame: a stage keeps what
+     it needs of a frame in its state.
+
+   - A stage may drop, rewrite, reorder and add events, but leaves at
+     most eventn events in eventv. It adds only event codes the clone
+     device has, i.e. those of the filter device after remapping.
+
+   - Event times are those of the kernel, in CLOCK_MONOTONIC unless the
+     kernel cannot timestamp events with it, in which case they are in
+     CLOCK_REALTIME. now and deadline are seconds of the same clock.
+
+   evdaemon logs the slowest batch of every stage when it stops, and
+   warns once about a stage taking more than a millisecond. */
+
+#include <linux/input.h>
+#include <stdint.h>
+
+/* Increased whenever the layout of the structures below or the meaning
+   of their members changes. evdaemon refuses stages built for another
+   version. */
+#define EVDAEMON_STAGE_ABI_VERSION 1
+
+#define EVDAEMON_STAGE_SYMBOL "evdaemon_stage"
+
+struct evdaemon_stage_batch {
+        struct input_event *eventv;
+        uint32_t            eventc;   /* Events in eventv. */
+        uint32_t            eventn;   /* Room in eventv. */
+        double              now;
+        double              deadline; /* Timer of the stage, 0 if off. */
+};
+
+struct evdaemon_stage {
+        uint32_t    abi_version;
+        uint32_t    reserved;
+        const char *name;
+
+        /* Makes the state of the stage for pipeline_i and stores it in
+           *statep. arg is the text after `:' in filter/stages, or NULL,
+           and is valid during the call only. Returns 0, or -1 and sets
+           errno. Optional. */
+        int  (*init)(void **statep, uint32_t pipeline_i, const char *arg);
+
+        /* Passes a non-empty batch through the stage. The stage may set
+           deadline to be called back by expire(). */
+        void (*process)(void *state, struct evdaemon_stage_batch *batch);
+
+        /* Called once deadline has passed, with deadline reset to 0 and
+           a batch of the events which already passed the stage in the
+           same wakeup, if any. Events the stage appends go on through
+           the rest of the chain. Optional. */
+        void (*expire)(void *state, struct evdaemon_stage_batch *batch);
+
+        /* Frees the state made by init(). Optional. */
+        void (*fini)(void *state);
+};
+
+extern const struct evdaemon_stage evdaemon_stage;
+
+#endif /* EVDAEMON_STAGE_H */
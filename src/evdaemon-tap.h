@@ -0,0 +1,83 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef EVDAEMON_TAP_H
+#define EVDAEMON_TAP_H
+
+/* Layout of the shared event tap of evdaemon.
+
+   A consumer connects to the tap socket of evdaemon and receives two file
+   descriptors in a single SCM_RIGHTS message: a memfd holding the ring
+   and an eventfd of its own. The memfd is open read-only and is mapped
+   with PROT_READ and MAP_SHARED. Only the owner of evdaemon can
+   connect. The connection must be kept open for as long as the consumer
+   reads, evdaemon drops the eventfd when it is closed.
+
+   evdaemon is the only writer. It never waits for consumers: a consumer
+   which falls more than slotc records behind has lost records. Record i
+   (counting from 0) is in slot i % slotc and is valid if its seq is
+   i + 1 both before and after it is copied out:
+
+     while (next < __atomic_load_n(&header->head, __ATOMIC_ACQUIRE)) {
+             if (header->head - next > header->slotc)
+                     next = header->head - header->slotc;  lost records
+             slot = &slotv[next % header->slotc];
+             if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != next + 1)
+                     continue;                              overwritten
+             record = *slot;
+             __atomic_thread_fence(__ATOMIC_ACQUIRE);
+             if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != next + 1)
+                     continue;                              overwritten
+             ++next;
+             use record
+     }
+
+   When the ring is empty, wait for the eventfd to become readable and
+   read it to clear it.
+
+   Event times are those of the kernel, in CLOCK_MONOTONIC unless the
+   kernel cannot timestamp events with it, in which case they are in
+   CLOCK_REALTIME. */
+
+#include <linux/input.h>
+#include <stdint.h>
+
+#define EVDAEMON_TAP_MAGIC   "evdtap"
+#define EVDAEMON_TAP_VERSION 1
+
+#define EVDAEMON_TAP_ROLE_FILTER  0 /* Events passed to the clone device. */
+#define EVDAEMON_TAP_ROLE_MONITOR 1 /* Events read from the monitor device. */
+
+struct evdaemon_tap_header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t slotc;
+        uint64_t head;
+        uint8_t  reserved[40];
+};
+
+struct evdaemon_tap_record {
+        uint64_t           seq;
+        uint32_t           role;
+        uint32_t           reserved;
+        struct input_event event;
+};
+
+/* The slots follow the header in the memfd. */
+#define EVDAEMON_TAP_SLOTV(header)                                      \
+        ((const struct evdaemon_tap_record *) ((header) + 1))
+
+#endif /* EVDAEMON_TAP_H */
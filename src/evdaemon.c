@@ -15,8 +15,13 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <getopt.h>
+#include <glob.h>
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
 #include <string.h>
 #include <syslog.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <signal.h>
 #include <stdio.h>
@@ -30,20 +35,118 @@
 #include "config.h"
 #include "util.h"
 #include "settings.h"
+#include "coalesce.h"
+#include "debounce.h"
+#include "feedback.h"
+#include "outqueue.h"
+#include "control.h"
+#include "probes.h"
+#include "monitors.h"
+#include "notify.h"
+#include "profile.h"
+#include "recorder.h"
+#include "stages.h"
+#include "tap.h"
+#include "timers.h"
+#ifdef HAVE_LIBURING
+#include "uring.h"
+#endif
 
-static const int SELECT_TIMEOUT_SECONDS = 1;
+#define EVENT_BUFC 64
+#define TAP_SLOTC  4096
+#define HELD_MAX   EVENT_BUFC
+#define RESYNC_MAX 32
+#define STAGE_BUFC (EVENT_BUFC + HELD_MAX + DEBOUNCE_HELD_MAX)
+#define OUT_BUFC   (STAGE_BUFC + COALESCE_FLUSH_MAX)
+
+#define IO_BACKEND_AUTO   0
+#define IO_BACKEND_SELECT 1
+#define IO_BACKEND_URING  2
+
+#ifdef HAVE_LIBURING
+static const unsigned URING_ENTRIES = 64;
+#endif
 
 extern char *program_invocation_name;
 extern char *program_invocation_short_name;
 
 static int            is_daemon        = 0;
+static int            is_checking      = 0;
 static int            is_running       = 1;
-static int            is_filtering     = 0;
-static int            filter_fd        = -1;
-static int            clone_fd         = -1;
-static int            monitor_fd       = -1;
-static struct timeval last_monitor_tv;
+static int            is_profiling     = 0;
+static volatile sig_atomic_t is_profile_requested = 0;
+static volatile sig_atomic_t is_dump_requested = 0;
+static volatile sig_atomic_t requested_preset_i = -1;
 static struct settings settings;
+static clockid_t      event_clock      = CLOCK_REALTIME;
+static int            is_holding       = 0;
+static int            io_backend       = IO_BACKEND_AUTO;
+
+/* A grabbed filter device and its clone. Every pipeline suppresses
+   events on its own, but all of them are driven by the same monitored
+   events. Filter events whose kernel timestamps fall in
+   [suppress_start, suppress_end) are suppressed. In passthrough mode the
+   filter device is grabbed only while suppressing, events before
+   grab_time reached other readers directly. While a hold code is down
+   the window stays open, timed_end being where timed suppression alone
+   would close it. When the kernel drops events of the filter device,
+   the broken frame is dropped and the keys passed down but no longer
+   down on the device are released. */
+struct pipeline {
+        const struct pipeline_settings *settings;
+        int                             filter_fd;
+        int                             clone_fd;
+        int                             is_grabbed;
+        double                          grab_time;
+        int                             is_filtering;
+        struct debounce                 debounce;
+        struct timer                    debounce_timer;
+        int                             is_debounce_due;
+        double                          suppress_start;
+        double                          suppress_end;
+        double                          timed_end;
+        struct timer                    suppress_timer;
+        struct input_event              heldv[HELD_MAX];
+        int                             heldc;
+        struct timer                    release_timer;
+        int                             is_release_due;
+        struct coalesce                 coalesce;
+        struct timer                    flush_timer;
+        int                             is_flush_due;
+        struct outqueue                 outqueue;
+        struct feedback                 feedback;
+        struct stages                   stages;
+        struct timer                    stage_timer;
+        int                             is_stage_due;
+        uint64_t                        passed_keyv[KEY_VALUEC];
+        int                             is_frame_dropped;
+        int                             is_resync_due;
+        int                             is_handover_due;
+        unsigned long                   syn_droppedc;
+};
+
+/* Compiled presets, the first one being the base configuration. Events
+   are decided by the active one, which a single pointer store
+   switches. */
+static struct preset        presetv[PRESETS_MAX];
+static int                  presetc = 0;
+static const struct preset *preset = &presetv[0];
+
+#define TIMER_PIPELINE(timer, member)                                   \
+        ((struct pipeline *) ((char *) (timer)                          \
+                              - offsetof(struct pipeline, member)))
+
+static struct pipeline pipelinev[PIPELINES_MAX];
+static struct timer    watchdog_timer;
+
+static struct {
+        unsigned long event_readc;
+        unsigned long event_writec;
+        unsigned long wakeupc;
+        unsigned long latencyc;
+        double        latency_sum;
+        double        latency_max;
+} io_stats;
 
 void help_and_exit(void)
 {
@@ -52,11 +155,41 @@ void help_and_exit(void)
         exit(EXIT_FAILURE);
 }
 
+static void compile_config(void)
+{
+        struct settings compiled;
+        int             retval;
+
+        memset(&compiled, 0, sizeof(struct settings));
+
+        if ((retval = settings_read_source(&compiled)) == 0)
+                retval = settings_write_snapshot(&compiled,
+                                                 PATH_CONFIG_SNAPSHOT);
+        switch (retval) {
+        case 0:
+                break;
+        case -1:
+                err(EXIT_FAILURE, "compile config");
+        default:
+                errx(EXIT_FAILURE, "compile config: %s",
+                     settings_strerror(retval));
+        }
+
+        printf("%s\n", PATH_CONFIG_SNAPSHOT);
+        settings_free(&compiled);
+        exit(EXIT_SUCCESS);
+}
+
 void parse_args(int argc, char **argv)
 {
         const struct option options[] = {
                 {"daemon", no_argument, NULL, 'd'},
                 {"config-dir", no_argument, NULL, 'c'},
+                {"control-socket", no_argument, NULL, 's'},
+                {"compile-config", no_argument, NULL, 'C'},
+                {"check", no_argument, NULL, 'k'},
+                {"io-backend", required_argument, NULL, 'b'},
+                {"profile", no_argument, NULL, 'p'},
                 {"version", no_argument, NULL, 'V'},
                 {"help", no_argument, NULL, 'h'},
                 {0, 0, 0, 0}
@@ -77,6 +210,32 @@ void parse_args(int argc, char **argv)
                 case 'c':
                         printf("%s\n", PATH_CONFIG_DIR);
                         exit(EXIT_SUCCESS);
+                case 's':
+                        printf("%s\n", PATH_CONTROL_SOCKET);
+                        exit(EXIT_SUCCESS);
+                case 'C':
+                        /* Does not return. */
+                        compile_config();
+                        break;
+                case 'k':
+                        is_checking = 1;
+                        break;
+                case 'b':
+                        if (strcmp(optarg, "auto") == 0) {
+                                io_backend = IO_BACKEND_AUTO;
+                        } else if (strcmp(optarg, "select") == 0) {
+                                io_backend = IO_BACKEND_SELECT;
+                        } else if (strcmp(optarg, "io_uring") == 0) {
+                                io_backend = IO_BACKEND_URING;
+                        } else {
+                                fprintf(stderr, "%s: unknown io backend `%s'\n",
+                                        program_invocation_name, optarg);
+                                help_and_exit();
+                        }
+                        break;
+                case 'p':
+                        is_profiling = 1;
+                        break;
                 case 'V':
                         printf("%s %s\n"
                                "Copyright © 2010 %s\n"
@@ -92,12 +251,27 @@ void parse_args(int argc, char **argv)
                                "Options:\n"
                                "     --daemon               run as a daemon process\n"
                                "     --config-dir           output configuration directory path and exit\n"
+                               "     --control-socket       output control socket path and exit\n"
+                               "     --compile-config       validate configuration, write it into a binary\n"
+                               "                            snapshot read at startup and exit\n"
+                               "     --check                load configuration, find devices without\n"
+                               "                            grabbing them, print what would be monitored\n"
+                               "                            and suppressed and exit\n"
+                               "     --io-backend=NAME      use NAME for event I/O: auto (default), select\n"
+                               "                            or io_uring\n"
+                               "     --profile              count cycles, instructions, cache misses and\n"
+                               "                            context switches per event processing stage,\n"
+                               "                            report on SIGUSR1 and at exit\n"
                                " -h, --help                 display this help and exit\n"
                                " -V, --version              output version infromation and exit\n"
                                "\n"
                                "Processing information and error messages are always printed into syslog. If\n"
                                "%s is not running as a daemon, logs are also printed into stderr.\n"
                                "\n"
+                               "On SIGUSR2, the most recent events and the decisions made about them are\n"
+                               "printed into the logs. On SIGRTMIN+N, preset N becomes active, 0 being the\n"
+                               "base configuration and the others the preset files in alphabetical order.\n"
+                               "\n"
                                "Report %s bugs to <%s>\n"
                                "Home page: <%s>\n",
                                program_invocation_name, PACKAGE_DESCRIPTION,
@@ -125,6 +299,52 @@ static void sigterm_handler(int signum)
         is_running = 0;
 }
 
+static void sigusr1_handler(int signum)
+{
+        is_profile_requested = 1;
+}
+
+static void sigusr2_handler(int signum)
+{
+        is_dump_requested = 1;
+}
+
+static void sigrtmin_handler(int signum)
+{
+        requested_preset_i = signum - SIGRTMIN;
+}
+
+/* Makes preset_i the active preset. Nothing is read or allocated, so
+   presets can be switched at any time. */
+static int select_preset(int preset_i)
+{
+        if (preset_i < 0 || preset_i >= presetc)
+                return -1;
+        preset = &presetv[preset_i];
+        syslog(LOG_INFO, "preset %s", preset->name);
+        return 0;
+}
+
+/* Serves requests made by signals, called by the event loops between
+   wakeups. */
+static void handle_signal_requests(void)
+{
+        if (is_profile_requested) {
+                is_profile_requested = 0;
+                profile_report();
+        }
+        if (is_dump_requested) {
+                is_dump_requested = 0;
+                recorder_dump();
+        }
+        if (requested_preset_i != -1) {
+                if (select_preset(requested_preset_i) == -1)
+                        syslog(LOG_WARNING, "no preset %d",
+                               (int) requested_preset_i);
+                requested_preset_i = -1;
+        }
+}
+
 static int daemonize(void)
 {
         int i;
@@ -174,225 +394,2370 @@ static int daemonize(void)
         return daemon_errno ? -1 : 0;
 }
 
-static int handle_filter(void)
+/* Returns non-zero if event is one of the events pipeline suppresses
+   while filtering. */
+static int is_maskable(const struct pipeline *pipeline,
+                       const struct input_event *event)
 {
-        struct timeval     now;
-        struct input_event event;
+        const struct preset_pipeline *decisions =
+                &preset->pipelinev[pipeline - pipelinev];
 
-        if (read(filter_fd, &event, sizeof(struct input_event)) == -1) {
-                syslog(LOG_ERR, "filter read: %s", strerror(errno));
-                return -1;
+        if (event->type == EV_KEY)
+                return bit_test64(event->code, decisions->filter_key_valuev)
+                        && event->value == 1;
+        if (event->type == EV_REL)
+                return bit_test64(event->code, decisions->filter_rel_valuev);
+        return 0;
+}
+
+/* Returns non-zero if event happened while a monitored event was
+   suppressing the events of pipeline. Only kernel timestamps are
+   compared, so delays of the event loop do not change the outcome. */
+static int is_in_suppress_window(const struct pipeline *pipeline,
+                                 const struct input_event *event)
+{
+        double time = timestamp(&event->time);
+
+        return time >= pipeline->suppress_start
+                && time < pipeline->suppress_end;
+}
+
+/* Keeps track of the keys of the filter device passed down to the
+   clone, in the codes of the filter device. */
+static void set_passed_key(struct pipeline *pipeline, int code, int is_down)
+{
+        uint64_t bit = (uint64_t) 1 << (code % 64);
+
+        if (is_down)
+                pipeline->passed_keyv[code / 64] |= bit;
+        else
+                pipeline->passed_keyv[code / 64] &= ~bit;
+}
+
+/* Suppresses or passes event, appending passed events to passv.
+   Returns the new number of events in passv. */
+static int decide_event(struct pipeline *pipeline,
+                        const struct input_event *event,
+                        struct input_event *passv, int passc)
+{
+        if (is_maskable(pipeline, event)
+            && is_in_suppress_window(pipeline, event)) {
+                PROBE_EVENT(filter_suppress, event);
+                recorder_add(event, RECORDER_FILTER_SUPPRESS, 1);
+                return passc;
         }
-        if (gettimeofday(&now, NULL) == -1) {
-                syslog(LOG_ERR, "gettimeofday: %s", strerror(errno));
-                return -1;
+        PROBE_EVENT(filter_forward, event);
+        recorder_add(event, RECORDER_FILTER_FORWARD, pipeline->is_filtering);
+        if (event->type == EV_KEY && event->code <= KEY_MAX
+            && event->value != 2)
+                set_passed_key(pipeline, event->code, event->value);
+        passv[passc] = *event;
+        remap_event(&pipeline->settings->filter_remap, &passv[passc]);
+        return passc + 1;
+}
+
+/* Decides the held events of pipeline which either fell into a
+   suppress window since they were read or have waited for the reorder
+   window, in order, and appends the passed ones to passv. If is_forced
+   is non-zero, the oldest held event is decided regardless. Returns the
+   new number of events in passv. */
+static int release_events(struct pipeline *pipeline, double now,
+                          int is_forced, struct input_event *passv,
+                          int passc)
+{
+        double reorder = pipeline->settings->filter_reorder;
+        int    releasec;
+
+        for (releasec = 0; releasec < pipeline->heldc; ++releasec) {
+                const struct input_event *event = &pipeline->heldv[releasec];
+
+                if (!(is_forced && releasec == 0)
+                    && is_maskable(pipeline, event)
+                    && !is_in_suppress_window(pipeline, event)
+                    && timestamp(&event->time) + reorder > now)
+                        break;
+                passc = decide_event(pipeline, event, passv, passc);
         }
+        pipeline->heldc -= releasec;
+        memmove(pipeline->heldv, &pipeline->heldv[releasec],
+                pipeline->heldc * sizeof(struct input_event));
+        return passc;
+}
 
-        if (timestamp(&now) - timestamp(&last_monitor_tv)
-            >= settings.filter_duration)
-                is_filtering = 0;
+/* Passes a filter event on to be decided. With a reorder window,
+   maskable events which are not suppressed yet are held until a late
+   monitored event could suppress them, and the events following them
+   are held too, to keep their order. Returns the new number of events
+   in passv. */
+static int hold_or_decide_event(struct pipeline *pipeline,
+                                const struct input_event *event,
+                                struct input_event *passv, int passc)
+{
+        if (pipeline->settings->filter_reorder > 0
+            && (pipeline->heldc || (is_maskable(pipeline, event)
+                                    && !is_in_suppress_window(pipeline,
+                                                              event)))) {
+                if (pipeline->heldc == HELD_MAX)
+                        passc = release_events(pipeline, 0, 1, passv, passc);
+                pipeline->heldv[pipeline->heldc++] = *event;
+                return passc;
+        }
+        return decide_event(pipeline, event, passv, passc);
+}
 
-        if (is_filtering) {
-                if (event.type == EV_KEY
-                    && bit_test64(event.code, settings.filter_key_valuev)
-                    && event.value == 1) {
-                        return 0;
-                }
-                if (event.type == EV_REL
-                    && bit_test64(event.code, settings.filter_rel_valuev)) {
-                        return 0;
-                }
+/* Passes on the releases the debouncer of pipeline held back and whose
+   window has passed by now, followed by a SYN_REPORT if is_framed is
+   non-zero. Returns the new number of events in passv. */
+static int release_debounced(struct pipeline *pipeline, double now,
+                             int is_framed, struct input_event *passv,
+                             int passc)
+{
+        struct input_event releasev[DEBOUNCE_HELD_MAX];
+        struct input_event syn;
+        int                releasec;
+        int                i;
+
+        releasec = debounce_release(&pipeline->debounce, now, releasev);
+        for (i = 0; i < releasec; ++i)
+                passc = hold_or_decide_event(pipeline, &releasev[i], passv,
+                                             passc);
+        if (releasec && is_framed) {
+                memset(&syn, 0, sizeof(struct input_event));
+                syn.time = releasev[releasec - 1].time;
+                syn.type = EV_SYN;
+                syn.code = SYN_REPORT;
+                passc = hold_or_decide_event(pipeline, &syn, passv, passc);
         }
-        if (write(clone_fd, &event, sizeof(struct input_event))
-            != sizeof(struct input_event))
-                return -1;
-        return 0;
+        return passc;
 }
 
-static int handle_monitor(void)
+/* Arms the debounce timer of pipeline for its oldest held release. */
+static int arm_debounce_timer(struct pipeline *pipeline)
 {
-        struct input_event event;
+        double deadline;
 
-        if (read(monitor_fd, &event, sizeof(struct input_event)) == -1) {
-                syslog(LOG_ERR, "monitor read: %s", strerror(errno));
+        if (!(deadline = debounce_deadline(&pipeline->debounce))) {
+                timers_cancel(&pipeline->debounce_timer);
+                return 0;
+        }
+        if (timers_arm(&pipeline->debounce_timer, deadline) == -1) {
+                syslog(LOG_ERR, "arm debounce timer: %s", strerror(errno));
                 return -1;
         }
+        return 0;
+}
 
-        if (event.type == EV_KEY) {
-                if (!bit_test64(event.code, settings.monitor_key_valuev)) {
-                        return 0;
-                }
-        } else if (event.type == EV_REL) {
-                if (!bit_test64(event.code, settings.monitor_rel_valuev)) {
-                        return 0;
-                }
-        } else {
+/* Arms the release timer of pipeline for its oldest held event. */
+static int arm_release_timer(struct pipeline *pipeline)
+{
+        if (!pipeline->heldc) {
+                timers_cancel(&pipeline->release_timer);
                 return 0;
         }
-
-        if (gettimeofday(&last_monitor_tv, NULL) == -1) {
-                syslog(LOG_ERR, "gettimeofday: %s", strerror(errno));
+        if (timers_arm(&pipeline->release_timer,
+                       timestamp(&pipeline->heldv[0].time)
+                       + pipeline->settings->filter_reorder) == -1) {
+                syslog(LOG_ERR, "arm release timer: %s", strerror(errno));
                 return -1;
         }
-        is_filtering = 1;
         return 0;
 }
 
-int main(int argc, char **argv)
+/* Copies the passc events in passv to stagev and passes them through
+   the filter stages of pipeline, which may grow them up to room events,
+   and arms the stage timer for the nearest stage deadline. Returns the
+   number of events in stagev or -1 on error. */
+static int run_stages(struct pipeline *pipeline,
+                      const struct input_event *passv, int passc, int room,
+                      struct input_event *stagev)
 {
-        struct timespec  timeout = {SELECT_TIMEOUT_SECONDS, 0};
-        struct sigaction sigact;
-        sigset_t         select_sigset;
-        int              exitval = EXIT_FAILURE;
-        int              syslog_options = LOG_ODELAY | LOG_PERROR;
-        int              settings_retval;
-
-        parse_args(argc, argv);
+        struct timeval now;
+        double         deadline;
 
-        openlog(program_invocation_short_name, syslog_options, LOG_DAEMON);
+        if (clock_gettimeval(event_clock, &now) == -1) {
+                syslog(LOG_ERR, "clock_gettime: %s", strerror(errno));
+                return -1;
+        }
+        memcpy(stagev, passv, passc * sizeof(struct input_event));
+        passc = stages_run(&pipeline->stages, timestamp(&now), stagev,
+                           passc, room);
 
-        syslog(LOG_INFO, "starting");
+        if (!(deadline = stages_deadline(&pipeline->stages))) {
+                timers_cancel(&pipeline->stage_timer);
+        } else if (timers_arm(&pipeline->stage_timer, deadline) == -1) {
+                syslog(LOG_ERR, "arm stage timer: %s", strerror(errno));
+                return -1;
+        }
+        return passc;
+}
 
-        memset(&sigact, 0, sizeof(struct sigaction));
-        sigact.sa_handler = &sigterm_handler;
+/* Copies the passc decided events in passv to outv, which must have
+   room for room + COALESCE_FLUSH_MAX events, where room is at least
+   passc and at most STAGE_BUFC. The events go through the filter
+   stages, which may add events up to room, and relative motion is
+   coalesced if enabled. Returns the number of events copied or -1 on
+   error. */
+static int forward_events(struct pipeline *pipeline,
+                          const struct input_event *passv, int passc,
+                          int room, struct input_event *outv)
+{
+        struct input_event stagev[STAGE_BUFC];
+        int                outc;
+        double             deadline;
 
-        if (sigfillset(&sigact.sa_mask) == -1) {
-                syslog(LOG_ERR, "sigfillset: %s", strerror(errno));
-                goto out;
+        if (stages_is_enabled(&pipeline->stages)) {
+                if ((passc = run_stages(pipeline, passv, passc, room,
+                                        stagev)) == -1)
+                        return -1;
+                passv = stagev;
         }
 
-        if (sigaction(SIGTERM, &sigact, NULL) == -1) {
-                syslog(LOG_ERR, "sigaction SIGTERM: %s", strerror(errno));
-                goto out;
+        if (!coalesce_is_enabled(&pipeline->coalesce)) {
+                memcpy(outv, passv, passc * sizeof(struct input_event));
+                return passc;
         }
 
-        if (!is_daemon && sigaction(SIGINT, &sigact, NULL) == -1) {
-                syslog(LOG_ERR, "sigaction SIGINT: %s", strerror(errno));
-                goto out;
+        outc = coalesce_events(&pipeline->coalesce, passv, passc, outv);
+        if (!(deadline = coalesce_deadline(&pipeline->coalesce))) {
+                timers_cancel(&pipeline->flush_timer);
+        } else if (timers_arm(&pipeline->flush_timer, deadline) == -1) {
+                syslog(LOG_ERR, "arm flush timer: %s", strerror(errno));
+                return -1;
         }
+        return outc;
+}
 
-        if (sigemptyset(&select_sigset) == -1) {
-                syslog(LOG_ERR, "sigemptyset: %s", strerror(errno));
-                goto out;
-        }
+/* Decides which of the eventc filter events in eventv are passed to the
+   clone device of pipeline and copies them to outv, which must have room
+   for OUT_BUFC events. Switch chatter is dropped first, see
+   hold_or_decide_event() for the rest. Returns the number of events
+   copied or -1 on error. */
+static int filter_events(struct pipeline *pipeline,
+                         const struct input_event *eventv, size_t eventc,
+                         struct input_event *outv)
+{
+        struct input_event passv[STAGE_BUFC];
+        struct timeval     now;
+        size_t             i;
+        int                passc = 0;
 
-        if (sigaddset(&select_sigset, SIGTERM) == -1) {
-                syslog(LOG_ERR, "sigaddset SIGTERM: %s", strerror(errno));
-                goto out;
+        if (pipeline->heldc) {
+                if (clock_gettimeval(event_clock, &now) == -1) {
+                        syslog(LOG_ERR, "clock_gettime: %s",
+                               strerror(errno));
+                        return -1;
+                }
+                passc = release_events(pipeline, timestamp(&now), 0, passv,
+                                       passc);
         }
 
-        if (!is_daemon && sigaddset(&select_sigset, SIGINT) == -1) {
-                syslog(LOG_ERR, "sigaddset SIGINT: %s", strerror(errno));
-                goto out;
+        for (i = 0; i < eventc; ++i) {
+                const struct input_event *event = &eventv[i];
+
+                if (!pipeline->is_grabbed
+                    || timestamp(&event->time) < pipeline->grab_time)
+                        continue;
+
+                PROBE_EVENT(filter_read, event);
+                /* The kernel dropped events: the frame in progress is
+                   broken, and the keys are resynced once it ends. */
+                if (event->type == EV_SYN && event->code == SYN_DROPPED) {
+                        pipeline->is_frame_dropped = 1;
+                        ++pipeline->syn_droppedc;
+                        continue;
+                }
+                if (pipeline->is_frame_dropped) {
+                        if (event->type == EV_SYN
+                            && event->code == SYN_REPORT) {
+                                pipeline->is_frame_dropped = 0;
+                                pipeline->is_resync_due = 1;
+                        }
+                        continue;
+                }
+                /* Releases whose window passed before event are not
+                   bounces anymore. They join the frame of event. */
+                if (debounce_is_holding(&pipeline->debounce))
+                        passc = release_debounced(pipeline,
+                                                  timestamp(&event->time), 0,
+                                                  passv, passc);
+                if (debounce_is_enabled(&pipeline->debounce)) {
+                        switch (debounce_event(&pipeline->debounce, event)) {
+                        case DEBOUNCE_DROP:
+                                PROBE_EVENT(filter_debounce, event);
+                                recorder_add(event, RECORDER_FILTER_DEBOUNCE,
+                                             pipeline->is_filtering);
+                                continue;
+                        case DEBOUNCE_HOLD:
+                                continue;
+                        }
+                }
+                passc = hold_or_decide_event(pipeline, event, passv, passc);
         }
 
-        settings_retval = settings_read(&settings);
-        switch (settings_retval) {
-        case 0:
-                break;
-        case -1:
-                syslog(LOG_ERR, "settings_read: %s", strerror(errno));
-                goto out;
-        default:
-                syslog(LOG_ERR, "settings_read: %s",
-                       settings_strerror(settings_retval));
-                goto out;
+        if (arm_release_timer(pipeline) == -1
+            || arm_debounce_timer(pipeline) == -1)
+                return -1;
+
+        return forward_events(pipeline, passv, passc, STAGE_BUFC, outv);
+}
+
+/* Returns non-zero if evdaemon has to interpose on the filter device of
+   pipeline. */
+static int is_grab_wanted(const struct pipeline *pipeline)
+{
+        return !pipeline->settings->filter_passthrough
+                || pipeline->is_filtering || pipeline->heldc
+                || debounce_is_holding(&pipeline->debounce);
+}
+
+/* Returns non-zero if the filter device of pipeline has to be read:
+   while it is grabbed, and while waiting for it to be grabbed. */
+static int is_filter_read(const struct pipeline *pipeline)
+{
+        return pipeline->is_grabbed || is_grab_wanted(pipeline);
+}
+
+/* Grabs or releases the filter device of a pipeline in passthrough mode
+   as suppression starts and stops. The device changes hands only when
+   none of its keys is down, so that every press is released to the
+   same reader which saw it. Until then the device is read to notice the
+   releases. Touch and tool codes do not defer the grab, since a palm
+   resting on a touchpad is what suppression is for. The reader which
+   saw such a contact begin sees it end once the device is given back,
+   and contacts the clone still has are released on it right after. */
+static int update_grab(struct pipeline *pipeline)
+{
+        struct timeval now;
+        int            keyc;
+
+        if (is_grab_wanted(pipeline) == pipeline->is_grabbed)
+                return 0;
+
+        if ((keyc = count_evdev_keys_down(pipeline->filter_fd)) == -1) {
+                syslog(LOG_ERR, "filter key state: %s", strerror(errno));
+                return -1;
         }
+        if (keyc)
+                return 0;
 
-        if ((monitor_fd = open_evdev_by_name(settings.monitor_name)) == -1) {
-                syslog(LOG_ERR, "open monitor %s: %s", settings.monitor_name,
-                       strerror(errno));
-                goto out;
+        if (clock_gettimeval(event_clock, &now) == -1) {
+                syslog(LOG_ERR, "clock_gettime: %s", strerror(errno));
+                return -1;
         }
 
-        if ((filter_fd = open_evdev_by_name(settings.filter_name)) == -1) {
-                syslog(LOG_ERR, "open filter %s: %s", settings.filter_name,
-                       strerror(errno));
-                goto out;
+        if (pipeline->is_grabbed) {
+                if (ioctl(pipeline->filter_fd, EVIOCGRAB, 0) == -1) {
+                        syslog(LOG_ERR, "release filter: %s",
+                               strerror(errno));
+                        return -1;
+                }
+                pipeline->is_grabbed = 0;
+                /* The release timer expiring now gets the releases
+                   written by expire_deadlines(). */
+                pipeline->is_handover_due = 1;
+                if (timers_arm(&pipeline->release_timer,
+                               timestamp(&now)) == -1) {
+                        syslog(LOG_ERR, "arm release timer: %s",
+                               strerror(errno));
+                        return -1;
+                }
+                return 0;
         }
 
-        if (ioctl(filter_fd, EVIOCGRAB, 1) == -1) {
+        /* Events queued before the grab were read by others too. */
+        if (ioctl(pipeline->filter_fd, EVIOCGRAB, 1) == -1) {
                 syslog(LOG_ERR, "grab filter: %s", strerror(errno));
-                goto out;
+                return -1;
         }
+        pipeline->grab_time = timestamp(&now);
+        pipeline->is_grabbed = 1;
+        return 0;
+}
 
-        if ((clone_fd = clone_evdev(filter_fd, &settings.clone_id,
-                                    settings.clone_name)) == -1) {
-                syslog(LOG_ERR, "clone_evdev: %s", strerror(errno));
-                goto out;
-        }
+static int update_grabs(void)
+{
+        int i;
 
-        if (is_daemon && daemonize() == -1) {
-                syslog(LOG_ERR, "daemonize: %s", strerror(errno));
-                goto out;
+        for (i = 0; i < settings.pipelinec; ++i) {
+                if (update_grab(&pipelinev[i]) == -1)
+                        return -1;
         }
+        return 0;
+}
 
-        syslog(LOG_INFO, "started");
+static void expire_suppress_timer(struct timer *timer,
+                                  const struct timeval *now)
+{
+        TIMER_PIPELINE(timer, suppress_timer)->is_filtering = 0;
+        PROBE_TIME(suppress_stop, now);
+}
 
-        while (is_running) {
-                fd_set rfds;
+static void expire_debounce_timer(struct timer *timer,
+                                  const struct timeval *now)
+{
+        TIMER_PIPELINE(timer, debounce_timer)->is_debounce_due = 1;
+}
 
-                FD_ZERO(&rfds);
-                FD_SET(monitor_fd, &rfds);
-                FD_SET(filter_fd, &rfds);
+static void expire_release_timer(struct timer *timer,
+                                 const struct timeval *now)
+{
+        TIMER_PIPELINE(timer, release_timer)->is_release_due = 1;
+}
 
-                switch (pselect(filter_fd + 1, &rfds, NULL, NULL, &timeout,
-                                &select_sigset)) {
-                case 0:
-                        break;
-                case -1:
-                        syslog(LOG_ERR, "select: %s", strerror(errno));
-                        goto out;
-                default:
-                        if (FD_ISSET(filter_fd, &rfds)) {
-                                if (handle_filter() == -1) {
-                                        goto out;
-                                }
-                        } else if (FD_ISSET(monitor_fd, &rfds)) {
-                                if (handle_monitor() == -1) {
-                                        goto out;
-                                }
-                        }
-                        break;
-                }
-        }
-        syslog(LOG_INFO, "stopped");
-        syslog(LOG_INFO, "terminating");
+static void expire_flush_timer(struct timer *timer,
+                               const struct timeval *now)
+{
+        TIMER_PIPELINE(timer, flush_timer)->is_flush_due = 1;
+}
 
-        exitval = EXIT_SUCCESS;
-out:
-        settings_free(&settings);
+static void expire_stage_timer(struct timer *timer,
+                               const struct timeval *now)
+{
+        TIMER_PIPELINE(timer, stage_timer)->is_stage_due = 1;
+}
 
-        if (clone_fd != -1) {
-                if (ioctl(clone_fd, UI_DEV_DESTROY) == -1) {
-                        syslog(LOG_ERR, "destroy clone: %s", strerror(errno));
-                        exitval = EXIT_FAILURE;
-                }
+/* Keep-alives are sent from the event loop itself, so a hung loop is
+   noticed by the service manager. */
+static void expire_watchdog_timer(struct timer *timer,
+                                  const struct timeval *now)
+{
+        if (notify_watchdog() == -1)
+                syslog(LOG_WARNING, "notify watchdog: %s", strerror(errno));
+        if (timers_arm(timer, timestamp(now)
+                       + notify_watchdog_interval()) == -1)
+                syslog(LOG_ERR, "arm watchdog timer: %s", strerror(errno));
+}
 
-                if (close(clone_fd) == -1) {
-                        syslog(LOG_ERR, "close clone: %s", strerror(errno));
-                        exitval = EXIT_FAILURE;
-                }
+/* Opens or extends the suppress window of pipeline for a monitored
+   event which happened at time. */
+static int suppress_from(struct pipeline *pipeline, double time)
+{
+        double end = time
+                + preset->pipelinev[pipeline - pipelinev].filter_duration;
+
+        if (time > pipeline->suppress_end || time < pipeline->suppress_start)
+                pipeline->suppress_start = time;
+        if (end > pipeline->timed_end)
+                pipeline->timed_end = end;
+        if (end <= pipeline->suppress_end)
+                return 0;
+        pipeline->suppress_end = end;
+        pipeline->is_filtering = 1;
+        if (timers_arm(&pipeline->suppress_timer, end) == -1) {
+                syslog(LOG_ERR, "arm suppress timer: %s", strerror(errno));
+                return -1;
         }
+        return 0;
+}
 
-        if (filter_fd != -1) {
-                if (ioctl(filter_fd, EVIOCGRAB, 0) == -1) {
-                        syslog(LOG_ERR, "release filter: %s", strerror(errno));
-                        exitval = EXIT_FAILURE;
-                }
+/* Opens the suppress window of pipeline for as long as a hold code
+   which went down at time stays down. */
+static void hold_from(struct pipeline *pipeline, double time)
+{
+        if (time > pipeline->suppress_end || time < pipeline->suppress_start)
+                pipeline->suppress_start = time;
+        pipeline->suppress_end = HUGE_VAL;
+        pipeline->is_filtering = 1;
+        timers_cancel(&pipeline->suppress_timer);
+}
 
-                if (close(filter_fd) == -1) {
-                        syslog(LOG_ERR, "close filter: %s", strerror(errno));
-                        exitval = EXIT_FAILURE;
-                }
+/* Closes the suppress window of pipeline when the last hold code went
+   up at time, unless timed suppression keeps it open longer. */
+static int release_hold(struct pipeline *pipeline, double time)
+{
+        pipeline->suppress_end = time > pipeline->timed_end
+                ? time : pipeline->timed_end;
+        if (timers_arm(&pipeline->suppress_timer,
+                       pipeline->suppress_end) == -1) {
+                syslog(LOG_ERR, "arm suppress timer: %s", strerror(errno));
+                return -1;
         }
+        return 0;
+}
 
-        if (monitor_fd != -1) {
-                if (close(monitor_fd) == -1) {
-                        syslog(LOG_ERR, "close monitor: %s", strerror(errno));
-                        exitval = EXIT_FAILURE;
-                }
+/* Follows the hold state of the monitored devices, which changed at
+   time if it changed at all. */
+static int update_holds(double time)
+{
+        unsigned int pipeline_i;
+
+        if (!monitors_is_holding() == !is_holding)
+                return 0;
+        is_holding = monitors_is_holding();
+        for (pipeline_i = 0; pipeline_i < settings.pipelinec; ++pipeline_i) {
+                if (is_holding)
+                        hold_from(&pipelinev[pipeline_i], time);
+                else if (release_hold(&pipelinev[pipeline_i], time) == -1)
+                        return -1;
         }
+        return 0;
+}
+
+/* Catches changes of the hold state no event carried: devices added
+   with a hold code down or removed while holding. */
+static int update_holds_now(void)
+{
+        struct timeval now;
+
+        if (!monitors_is_holding() == !is_holding)
+                return 0;
+        if (clock_gettimeval(event_clock, &now) == -1) {
+                syslog(LOG_ERR, "clock_gettime: %s", strerror(errno));
+                return -1;
+        }
+        return update_holds(timestamp(&now));
+}
+
+static int monitor_events(int monitor_i, const struct input_event *eventv,
+                          size_t eventc)
+{
+        size_t       i;
+        unsigned int pipeline_i;
+        int          is_filtering = 0;
+
+        for (pipeline_i = 0; pipeline_i < settings.pipelinec; ++pipeline_i)
+                is_filtering |= pipelinev[pipeline_i].is_filtering;
+
+        if (settings.tap_monitor)
+                tap_publish(EVDAEMON_TAP_ROLE_MONITOR, eventv, eventc);
+
+        for (i = 0; i < eventc; ++i) {
+                const struct input_event *event = &eventv[i];
+
+                PROBE_EVENT(monitor_read, event);
+                if (monitors_hold_event(monitor_i, event)) {
+                        PROBE_EVENT(monitor_accept, event);
+                        recorder_add(event, RECORDER_MONITOR_ACCEPT,
+                                     is_filtering);
+                        if (update_holds(timestamp(&event->time)) == -1)
+                                return -1;
+                        is_filtering |= is_holding;
+                        continue;
+                }
+                if (!(event->type == EV_KEY
+                      && bit_test64(event->code, preset->monitor_key_valuev))
+                    && !(event->type == EV_REL
+                         && bit_test64(event->code,
+                                       preset->monitor_rel_valuev))) {
+                        PROBE_EVENT(monitor_reject, event);
+                        recorder_add(event, RECORDER_MONITOR_REJECT,
+                                     is_filtering);
+                        continue;
+                }
+
+                PROBE_EVENT(monitor_accept, event);
+                recorder_add(event, RECORDER_MONITOR_ACCEPT, is_filtering);
+                if (!is_filtering)
+                        PROBE_TIME(suppress_start, &event->time);
+                is_filtering = 1;
+                for (pipeline_i = 0; pipeline_i < settings.pipelinec;
+                     ++pipeline_i) {
+                        if (suppress_from(&pipelinev[pipeline_i],
+                                          timestamp(&event->time)) == -1)
+                                return -1;
+                }
+        }
+        return 0;
+}
+
+/* Converts the return value of a read(2) of event device into a
+   number of events. Returns -1 if the read failed or returned a partial
+   event. */
+static int read_eventc(ssize_t bytes, const char *role)
+{
+        if (bytes == -1) {
+                /* Interrupted and spurious wakeups read nothing. */
+                if (errno == EINTR || errno == EAGAIN)
+                        return 0;
+                syslog(LOG_ERR, "%s read: %s", role, strerror(errno));
+                return -1;
+        }
+        if (bytes % sizeof(struct input_event)) {
+                syslog(LOG_ERR, "%s read: partial event", role);
+                return -1;
+        }
+        io_stats.event_readc += bytes / sizeof(struct input_event);
+        return bytes / sizeof(struct input_event);
+}
+
+/* Writes events to the clone device without blocking. Whatever the
+   device does not accept at once is queued and flushed when it becomes
+   writable again, see outqueue.h for the overflow policy. */
+static int write_events(struct pipeline *pipeline,
+                        const struct input_event *eventv, int eventc)
+{
+        int droppedc;
+
+        if (eventc == 0)
+                return 0;
+        droppedc = outqueue_write(&pipeline->outqueue, pipeline->clone_fd,
+                                  eventv, eventc);
+        if (droppedc == -1) {
+                syslog(LOG_ERR, "clone write: %s", strerror(errno));
+                return -1;
+        }
+        if (droppedc)
+                PROBE_WRITE(clone_drop, droppedc);
+        io_stats.event_writec += eventc - droppedc;
+        PROBE_WRITE(clone_write, eventc);
+        if (settings.tap_filter)
+                tap_publish(EVDAEMON_TAP_ROLE_FILTER, eventv, eventc);
+        return 0;
+}
+
+static int flush_outqueue(struct pipeline *pipeline)
+{
+        if (outqueue_flush(&pipeline->outqueue, pipeline->clone_fd) == -1) {
+                syslog(LOG_ERR, "clone write: %s", strerror(errno));
+                return -1;
+        }
+        return 0;
+}
+
+/* Passes LEDs, sounds and force feedback written to the clone on to
+   the filter device. */
+static int handle_clone(struct pipeline *pipeline)
+{
+        if (feedback_handle(&pipeline->feedback, pipeline->clone_fd,
+                            pipeline->filter_fd) == -1) {
+                syslog(LOG_ERR, "clone read: %s", strerror(errno));
+                return -1;
+        }
+        return 0;
+}
+
+/* Accounts the delay from the kernel timestamp of the oldest of the
+   eventc events read to their decision. */
+static void account_latency(const struct input_event *eventv, int eventc)
+{
+        struct timeval now;
+        double         latency;
+
+        if (eventc == 0 || clock_gettimeval(event_clock, &now) == -1)
+                return;
+        latency = timestamp(&now) - timestamp(&eventv[0].time);
+        io_stats.latency_sum += latency;
+        ++io_stats.latencyc;
+        if (latency > io_stats.latency_max)
+                io_stats.latency_max = latency;
+}
+
+static int handle_filter(struct pipeline *pipeline)
+{
+        struct input_event eventv[EVENT_BUFC];
+        struct input_event outv[OUT_BUFC];
+        int                eventc;
+        int                outc;
+
+        PROFILE_START();
+
+        eventc = read_eventc(read(pipeline->filter_fd, eventv,
+                                  sizeof(eventv)), "filter");
+        if (eventc == -1)
+                return -1;
+
+        PROFILE_MARK(PROFILE_STAGE_FILTER_READ, eventc);
+
+        if ((outc = filter_events(pipeline, eventv, eventc, outv)) == -1)
+                return -1;
+
+        PROFILE_MARK(PROFILE_STAGE_FILTER_DECIDE, eventc);
+        account_latency(eventv, eventc);
+
+        if (write_events(pipeline, outv, outc) == -1)
+                return -1;
+
+        PROFILE_MARK(PROFILE_STAGE_FILTER_WRITE, eventc);
+        return 0;
+}
+
+/* Converts the return value of a read(2) of a monitored device into a
+   number of events. An unplugged device is dropped from the monitored
+   set and reads as no events. */
+static int read_monitor_eventc(int monitor_i, ssize_t bytes)
+{
+        if (bytes == -1 && errno == ENODEV) {
+                monitors_remove(monitor_i);
+                return 0;
+        }
+        return read_eventc(bytes, "monitor");
+}
+
+static int handle_monitor(int monitor_i)
+{
+        struct input_event eventv[EVENT_BUFC];
+        int                eventc;
+
+        PROFILE_START();
+
+        eventc = read_monitor_eventc(monitor_i,
+                                     read(monitors_fdv[monitor_i], eventv,
+                                          sizeof(eventv)));
+        if (eventc == -1)
+                return -1;
+
+        if (monitor_events(monitor_i, eventv, eventc) == -1)
+                return -1;
+
+        PROFILE_MARK(PROFILE_STAGE_MONITOR, eventc);
+        return 0;
+}
+
+/* Adds hotplugged devices to the monitored set. Failing to watch for
+   new devices is not fatal for the already monitored ones. Returns the
+   number of devices added. */
+static int handle_monitors_inotify(void)
+{
+        int addedc;
+
+        if ((addedc = monitors_handle_inotify()) == -1) {
+                syslog(LOG_WARNING, "inotify read: %s", strerror(errno));
+                return 0;
+        }
+        return addedc;
+}
+
+/* Expires the timers whose deadlines have passed. */
+static int handle_timers(void)
+{
+        if (timers_expire() == -1) {
+                syslog(LOG_ERR, "timers: %s", strerror(errno));
+                return -1;
+        }
+        return 0;
+}
+
+/* Programs the timerfd to the nearest deadline before waiting. */
+static int update_timers(void)
+{
+        if (timers_update() == -1) {
+                syslog(LOG_ERR, "timerfd_settime: %s", strerror(errno));
+                return -1;
+        }
+        return 0;
+}
+
+/* Appends releases of the keys passed down to the clone of pipeline
+   but not down on the filter device anymore, or of all of them if
+   is_all is non-zero, at most RESYNC_MAX events with the closing
+   SYN_REPORT, to passv. Returns the new number of events in passv or -1
+   on error. */
+static int resync_keys(struct pipeline *pipeline, const struct timeval *now,
+                       int is_all, struct input_event *passv, int passc)
+{
+        uint8_t            keybits[KEY_MAX / 8 + 1];
+        struct input_event event;
+        int                releasec = 0;
+        int                code;
+
+        memset(keybits, 0, sizeof(keybits));
+        if (!is_all && ioctl(pipeline->filter_fd,
+                             EVIOCGKEY(sizeof(keybits)), keybits) == -1) {
+                syslog(LOG_ERR, "filter key state: %s", strerror(errno));
+                return -1;
+        }
+
+        memset(&event, 0, sizeof(struct input_event));
+        event.time = *now;
+        event.type = EV_KEY;
+        for (code = 0; code <= KEY_MAX && releasec < RESYNC_MAX - 1;
+             ++code) {
+                if (!bit_test64(code, pipeline->passed_keyv)
+                    || bit_test8(code, keybits))
+                        continue;
+                set_passed_key(pipeline, code, 0);
+                passv[passc] = event;
+                passv[passc].code = code;
+                remap_event(&pipeline->settings->filter_remap,
+                            &passv[passc++]);
+                ++releasec;
+        }
+        if (releasec) {
+                passv[passc] = event;
+                passv[passc].type = EV_SYN;
+                passv[passc++].code = SYN_REPORT;
+        }
+        return passc;
+}
+
+/* Copies the events of expired forward path deadlines of pipeline,
+   i.e. releases held back by debouncing, released held events, key
+   releases after dropped events, events of filter stages and flushed
+   motion, to outv, which must have room for OUT_BUFC events. Returns
+   the number of events copied or -1 on error. */
+static int expire_deadlines(struct pipeline *pipeline,
+                            struct input_event *outv)
+{
+        struct input_event passv[DEBOUNCE_HELD_MAX + 1 + HELD_MAX
+                                 + RESYNC_MAX];
+        struct timeval     now;
+        int                passc = 0;
+        int                outc = 0;
+
+        if (!pipeline->is_release_due && !pipeline->is_flush_due
+            && !pipeline->is_stage_due && !pipeline->is_resync_due
+            && !pipeline->is_debounce_due)
+                return 0;
+
+        if (clock_gettimeval(event_clock, &now) == -1) {
+                syslog(LOG_ERR, "clock_gettime: %s", strerror(errno));
+                return -1;
+        }
+
+        if (pipeline->is_release_due || pipeline->is_stage_due
+            || pipeline->is_resync_due || pipeline->is_debounce_due) {
+                /* Releases held back by debouncing were read first, and
+                   may be held for reordering in turn. */
+                if (pipeline->is_debounce_due) {
+                        pipeline->is_debounce_due = 0;
+                        passc = release_debounced(pipeline, timestamp(&now),
+                                                  1, passv, 0);
+                        if (arm_debounce_timer(pipeline) == -1
+                            || arm_release_timer(pipeline) == -1)
+                                return -1;
+                }
+                /* Held events precede the resync, so that no press
+                   passes after the key was found up. */
+                if (pipeline->is_release_due || pipeline->is_resync_due) {
+                        pipeline->is_release_due = 0;
+                        passc = release_events(pipeline,
+                                               pipeline->is_resync_due
+                                               ? HUGE_VAL : timestamp(&now),
+                                               0, passv, passc);
+                        if (arm_release_timer(pipeline) == -1)
+                                return -1;
+                }
+                /* A device given back to other readers leaves nothing
+                   down on the clone. */
+                if (pipeline->is_resync_due || pipeline->is_handover_due) {
+                        if ((passc = resync_keys(pipeline, &now,
+                                                 pipeline->is_handover_due,
+                                                 passv, passc)) == -1)
+                                return -1;
+                        pipeline->is_resync_due = 0;
+                        pipeline->is_handover_due = 0;
+                }
+                /* The stages are called back on the way. A flush may
+                   follow. */
+                pipeline->is_stage_due = 0;
+                if ((outc = forward_events(pipeline, passv, passc,
+                                           STAGE_BUFC - COALESCE_FLUSH_MAX,
+                                           outv)) == -1)
+                        return -1;
+        }
+
+        if (pipeline->is_flush_due) {
+                pipeline->is_flush_due = 0;
+                outc += coalesce_flush(&pipeline->coalesce, &now,
+                                       &outv[outc]);
+        }
+        return outc;
+}
+
+/* Accepts a new tap consumer. Failing to serve a consumer is not fatal
+   for the event path. Returns the index of the new client or -1. */
+static int accept_tap_client(void)
+{
+        int client_i;
+
+        if ((client_i = tap_accept()) == -1 && errno != EAGAIN)
+                syslog(LOG_WARNING, "tap accept: %s", strerror(errno));
+        return client_i;
+}
+
+/* Accepts a new control client. Returns the index of the new client or
+   -1. */
+static int accept_control_client(void)
+{
+        int client_i;
+
+        if ((client_i = control_accept()) == -1 && errno != EAGAIN)
+                syslog(LOG_WARNING, "control accept: %s", strerror(errno));
+        return client_i;
+}
+
+static int run_select_loop(const sigset_t *select_sigset)
+{
+        struct input_event outv[OUT_BUFC];
+        int                outc;
+        int                nfds;
+        int                i;
+
+        while (is_running) {
+                fd_set rfds;
+                fd_set wfds;
+
+                if (update_holds_now() == -1)
+                        return -1;
+                if (update_grabs() == -1)
+                        return -1;
+                if (update_timers() == -1)
+                        return -1;
+
+                FD_ZERO(&rfds);
+                FD_ZERO(&wfds);
+                FD_SET(timers_fd(), &rfds);
+                nfds = timers_fd() + 1;
+
+                for (i = 0; i < settings.pipelinec; ++i) {
+                        int fd = pipelinev[i].filter_fd;
+                        FD_SET(pipelinev[i].clone_fd, &rfds);
+                        if (pipelinev[i].clone_fd >= nfds)
+                                nfds = pipelinev[i].clone_fd + 1;
+                        if (!outqueue_is_empty(&pipelinev[i].outqueue))
+                                FD_SET(pipelinev[i].clone_fd, &wfds);
+                        if (!is_filter_read(&pipelinev[i]))
+                                continue;
+                        FD_SET(fd, &rfds);
+                        if (fd >= nfds)
+                                nfds = fd + 1;
+                }
+                for (i = 0; i < MONITORS_MAX; ++i) {
+                        int fd = monitors_fdv[i];
+                        if (fd == -1)
+                                continue;
+                        FD_SET(fd, &rfds);
+                        if (fd >= nfds)
+                                nfds = fd + 1;
+                }
+                if (monitors_inotify_fd() != -1) {
+                        FD_SET(monitors_inotify_fd(), &rfds);
+                        if (monitors_inotify_fd() >= nfds)
+                                nfds = monitors_inotify_fd() + 1;
+                }
+
+                if (tap_is_open()) {
+                        FD_SET(tap_listen_fd(), &rfds);
+                        if (tap_listen_fd() >= nfds)
+                                nfds = tap_listen_fd() + 1;
+                        for (i = 0; i < TAP_CLIENTS_MAX; ++i) {
+                                int fd = tap_client_fd(i);
+                                if (fd == -1)
+                                        continue;
+                                FD_SET(fd, &rfds);
+                                if (fd >= nfds)
+                                        nfds = fd + 1;
+                        }
+                }
+
+                if (control_is_open()) {
+                        FD_SET(control_listen_fd(), &rfds);
+                        if (control_listen_fd() >= nfds)
+                                nfds = control_listen_fd() + 1;
+                        for (i = 0; i < CONTROL_CLIENTS_MAX; ++i) {
+                                int fd = control_client_fd(i);
+                                if (fd == -1)
+                                        continue;
+                                FD_SET(fd, &rfds);
+                                if (fd >= nfds)
+                                        nfds = fd + 1;
+                        }
+                }
+
+                switch (pselect(nfds, &rfds, &wfds, NULL, NULL,
+                                select_sigset)) {
+                case 0:
+                        break;
+                case -1:
+                        if (errno == EINTR)
+                                break;
+                        syslog(LOG_ERR, "select: %s", strerror(errno));
+                        return -1;
+                default:
+                        ++io_stats.wakeupc;
+                        /* Suppression which has just expired must not
+                           affect the filter events of this round. */
+                        if (FD_ISSET(timers_fd(), &rfds)) {
+                                if (handle_timers() == -1)
+                                        return -1;
+                        }
+                        for (i = 0; i < MONITORS_MAX; ++i) {
+                                int fd = monitors_fdv[i];
+                                if (fd == -1 || !FD_ISSET(fd, &rfds))
+                                        continue;
+                                if (handle_monitor(i) == -1)
+                                        return -1;
+                        }
+                        /* Queued events go first to keep their order. */
+                        for (i = 0; i < settings.pipelinec; ++i) {
+                                if (!FD_ISSET(pipelinev[i].clone_fd, &wfds))
+                                        continue;
+                                if (flush_outqueue(&pipelinev[i]) == -1)
+                                        return -1;
+                        }
+                        for (i = 0; i < settings.pipelinec; ++i) {
+                                if (!is_filter_read(&pipelinev[i])
+                                    || !FD_ISSET(pipelinev[i].filter_fd,
+                                                 &rfds))
+                                        continue;
+                                if (handle_filter(&pipelinev[i]) == -1)
+                                        return -1;
+                        }
+                        /* Feedback comes after the forward path. */
+                        for (i = 0; i < settings.pipelinec; ++i) {
+                                if (!FD_ISSET(pipelinev[i].clone_fd, &rfds))
+                                        continue;
+                                if (handle_clone(&pipelinev[i]) == -1)
+                                        return -1;
+                        }
+                        if (monitors_inotify_fd() != -1
+                            && FD_ISSET(monitors_inotify_fd(), &rfds))
+                                handle_monitors_inotify();
+                        if (control_is_open()) {
+                                for (i = 0; i < CONTROL_CLIENTS_MAX; ++i) {
+                                        int fd = control_client_fd(i);
+                                        if (fd != -1 && FD_ISSET(fd, &rfds))
+                                                control_handle_client(i);
+                                }
+                                if (FD_ISSET(control_listen_fd(), &rfds))
+                                        accept_control_client();
+                        }
+                        if (!tap_is_open())
+                                break;
+                        for (i = 0; i < TAP_CLIENTS_MAX; ++i) {
+                                int fd = tap_client_fd(i);
+                                if (fd != -1 && FD_ISSET(fd, &rfds))
+                                        tap_handle_client(i);
+                        }
+                        if (FD_ISSET(tap_listen_fd(), &rfds))
+                                accept_tap_client();
+                        break;
+                }
+
+                handle_signal_requests();
+
+                for (i = 0; i < settings.pipelinec; ++i) {
+                        if ((outc = expire_deadlines(&pipelinev[i],
+                                                     outv)) == -1)
+                                return -1;
+                        if (write_events(&pipelinev[i], outv, outc) == -1)
+                                return -1;
+                }
+
+                if (tap_is_open())
+                        tap_notify();
+        }
+        return 0;
+}
+
+#ifdef HAVE_LIBURING
+enum uring_tag {
+        URING_TAG_TAP_LISTEN = 1,
+        URING_TAG_INOTIFY,
+        URING_TAG_TIMERS,
+        URING_TAG_CONTROL_LISTEN,
+        URING_TAG_FILTER = 16, /* One tag per pipeline. */
+        URING_TAG_CLONE = URING_TAG_FILTER + PIPELINES_MAX,
+        URING_TAG_FLUSH = URING_TAG_CLONE + PIPELINES_MAX,
+        URING_TAG_CLONE_POLL = URING_TAG_FLUSH + PIPELINES_MAX,
+        URING_TAG_CLONE_READ = URING_TAG_CLONE_POLL + PIPELINES_MAX,
+        URING_TAG_TAP_CLIENT = URING_TAG_CLONE_READ + PIPELINES_MAX,
+                               /* One tag per tap client. */
+        URING_TAG_CONTROL_CLIENT = URING_TAG_TAP_CLIENT + TAP_CLIENTS_MAX,
+                                   /* One tag per control client. */
+        URING_TAG_MONITOR = URING_TAG_CONTROL_CLIENT + CONTROL_CLIENTS_MAX,
+                            /* One tag per monitored device. */
+        URING_TAG_END = URING_TAG_MONITOR + MONITORS_MAX
+};
+
+/* Buffers of one pipeline which the kernel reads into or writes from
+   while the operations are in flight. */
+struct uring_pipeline {
+        struct input_event filter_eventv[EVENT_BUFC];
+        struct input_event clone_eventv[OUT_BUFC];
+        int                clone_size;
+        struct input_event flush_eventv[OUT_BUFC];
+        int                flush_size;
+        int                filter_res;
+        int                is_filter_pending;
+        int                is_filter_armed;
+        int                is_clone_pending;
+        int                is_clone_polled;
+};
+
+static struct input_event    uring_monitor_eventv[MONITORS_MAX][EVENT_BUFC];
+static int                   uring_monitor_is_armedv[MONITORS_MAX];
+static struct uring_pipeline uring_pipelinev[PIPELINES_MAX];
+
+/* Queues a read for every monitored device which has none pending,
+   i.e. for devices added since the previous call. */
+static int arm_uring_monitors(void)
+{
+        int i;
+
+        for (i = 0; i < MONITORS_MAX; ++i) {
+                if (monitors_fdv[i] == -1 || uring_monitor_is_armedv[i])
+                        continue;
+                if (uring_prep_read(monitors_fdv[i], uring_monitor_eventv[i],
+                                    sizeof(uring_monitor_eventv[i]),
+                                    URING_TAG_MONITOR + i, 0) == -1)
+                        return -1;
+                uring_monitor_is_armedv[i] = 1;
+        }
+        return 0;
+}
+
+static int arm_uring_filter(int pipeline_i)
+{
+        struct uring_pipeline *uring_pipeline = &uring_pipelinev[pipeline_i];
+
+        uring_pipeline->is_filter_armed = 1;
+        return uring_prep_read(pipelinev[pipeline_i].filter_fd,
+                               uring_pipeline->filter_eventv,
+                               sizeof(uring_pipeline->filter_eventv),
+                               URING_TAG_FILTER + pipeline_i, 0);
+}
+
+/* Queues a read for every filter device which has to be read but has
+   none pending, i.e. for devices grabbed since the previous call. A
+   read is not queued before the clone write of the previous batch has
+   completed. */
+static int arm_uring_filters(void)
+{
+        int i;
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                struct uring_pipeline *uring_pipeline = &uring_pipelinev[i];
+
+                if (!is_filter_read(&pipelinev[i])
+                    || uring_pipeline->is_filter_armed
+                    || uring_pipeline->is_filter_pending
+                    || uring_pipeline->is_clone_pending)
+                        continue;
+                if (arm_uring_filter(i) == -1)
+                        return -1;
+        }
+        return 0;
+}
+
+/* Waits for the clone device of a pipeline to accept its queued
+   events. */
+static int poll_uring_clone(int pipeline_i)
+{
+        struct uring_pipeline *uring_pipeline = &uring_pipelinev[pipeline_i];
+
+        if (uring_pipeline->is_clone_polled)
+                return 0;
+        uring_pipeline->is_clone_polled = 1;
+        return uring_prep_poll_out(pipelinev[pipeline_i].clone_fd,
+                                   URING_TAG_CLONE_POLL + pipeline_i);
+}
+
+/* Queues events behind those already waiting for the clone device of a
+   pipeline, which keeps them in order. */
+static int queue_uring_events(int pipeline_i,
+                              const struct input_event *eventv, int eventc)
+{
+        int droppedc;
+
+        droppedc = outqueue_push(&pipelinev[pipeline_i].outqueue,
+                                 eventv, eventc);
+        if (droppedc)
+                PROBE_WRITE(clone_drop, droppedc);
+        io_stats.event_writec += eventc - droppedc;
+        return poll_uring_clone(pipeline_i);
+}
+
+/* Checks a completed clone write. Events which the device did not
+   accept because it was busy are queued. */
+static int check_uring_write(int pipeline_i,
+                             const struct input_event *eventv, int res,
+                             int size)
+{
+        struct outqueue *outqueue = &pipelinev[pipeline_i].outqueue;
+        int              eventc = size / sizeof(struct input_event);
+        int              droppedc;
+
+        if (res == -EAGAIN)
+                res = 0;
+        if (res < 0) {
+                syslog(LOG_ERR, "clone write: %s", strerror(-res));
+                return -1;
+        }
+        if (res % sizeof(struct input_event)) {
+                syslog(LOG_ERR, "clone write: partial event");
+                return -1;
+        }
+        PROBE_WRITE(clone_write, res / sizeof(struct input_event));
+        if (res == size) {
+                outqueue->writec += eventc;
+                return 0;
+        }
+        droppedc = outqueue_push_unwritten(outqueue, eventv, eventc,
+                                           res / sizeof(struct input_event));
+        if (droppedc) {
+                PROBE_WRITE(clone_drop, droppedc);
+                io_stats.event_writec -= droppedc;
+        }
+        return poll_uring_clone(pipeline_i);
+}
+
+static int handle_uring_clone_poll(int pipeline_i, int res)
+{
+        uring_pipelinev[pipeline_i].is_clone_polled = 0;
+        if (res < 0) {
+                syslog(LOG_ERR, "clone poll: %s", strerror(-res));
+                return -1;
+        }
+        if (flush_outqueue(&pipelinev[pipeline_i]) == -1)
+                return -1;
+        if (outqueue_is_empty(&pipelinev[pipeline_i].outqueue))
+                return 0;
+        return poll_uring_clone(pipeline_i);
+}
+
+static int handle_uring_filter(int pipeline_i, int res)
+{
+        struct pipeline       *pipeline = &pipelinev[pipeline_i];
+        struct uring_pipeline *uring_pipeline = &uring_pipelinev[pipeline_i];
+        int                    eventc;
+        int                    outc;
+        int                    is_rearming;
+
+        uring_pipeline->is_filter_armed = 0;
+        /* The clone write linked before the read was not fully
+           accepted, the read is queued again by arm_uring_filters. */
+        if (res == -ECANCELED)
+                return 0;
+        errno = -res;
+        eventc = read_eventc(res < 0 ? -1 : res, "filter");
+        if (eventc == -1)
+                return -1;
+        /* Reads and writes are done by the kernel when the ring is
+           submitted, only decisions can be profiled here. */
+        PROFILE_START();
+        outc = filter_events(pipeline, uring_pipeline->filter_eventv, eventc,
+                             uring_pipeline->clone_eventv);
+        if (outc == -1)
+                return -1;
+        PROFILE_MARK(PROFILE_STAGE_FILTER_DECIDE, eventc);
+        account_latency(uring_pipeline->filter_eventv, eventc);
+        uring_pipeline->clone_size = outc * sizeof(struct input_event);
+        /* A device released in passthrough mode is not read anymore. */
+        is_rearming = is_filter_read(pipeline);
+        if (settings.tap_filter)
+                tap_publish(EVDAEMON_TAP_ROLE_FILTER,
+                            uring_pipeline->clone_eventv, outc);
+        if (outc > 0 && (!outqueue_is_direct(&pipeline->outqueue)
+                         || uring_pipeline->is_clone_polled)) {
+                if (queue_uring_events(pipeline_i,
+                                       uring_pipeline->clone_eventv,
+                                       outc) == -1)
+                        return -1;
+                return is_rearming ? arm_uring_filter(pipeline_i) : 0;
+        }
+        if (outc > 0) {
+                if (uring_prep_write(pipeline->clone_fd,
+                                     uring_pipeline->clone_eventv,
+                                     uring_pipeline->clone_size,
+                                     URING_TAG_CLONE + pipeline_i,
+                                     is_rearming) == -1)
+                        return -1;
+                uring_pipeline->is_clone_pending = 1;
+        }
+        io_stats.event_writec += outc;
+        return is_rearming ? arm_uring_filter(pipeline_i) : 0;
+}
+
+static int handle_uring_monitor(int monitor_i, int res)
+{
+        int eventc;
+
+        uring_monitor_is_armedv[monitor_i] = 0;
+        errno = -res;
+        eventc = read_monitor_eventc(monitor_i, res < 0 ? -1 : res);
+        if (eventc == -1)
+                return -1;
+        PROFILE_START();
+        if (monitor_events(monitor_i, uring_monitor_eventv[monitor_i],
+                           eventc) == -1)
+                return -1;
+        PROFILE_MARK(PROFILE_STAGE_MONITOR, eventc);
+        return arm_uring_monitors();
+}
+
+/* Handles one completion of the io_uring event loop and queues the next
+   operation of the same fd. Filter reads are re-armed only after the
+   clone write of the previous batch has completed (linked SQEs), which
+   lets the single clone buffer of each pipeline be reused safely. */
+static int handle_uring_completion(uintptr_t tag, int res)
+{
+        struct uring_pipeline *uring_pipeline;
+        int                    pipeline_i;
+        int                    client_i;
+
+        if (tag >= URING_TAG_MONITOR && tag < URING_TAG_END)
+                return handle_uring_monitor(tag - URING_TAG_MONITOR, res);
+
+        if (tag >= URING_TAG_CONTROL_CLIENT && tag < URING_TAG_MONITOR) {
+                client_i = tag - URING_TAG_CONTROL_CLIENT;
+                if (!control_handle_client(client_i))
+                        return 0;
+                return uring_prep_poll(control_client_fd(client_i), tag);
+        }
+
+        if (tag >= URING_TAG_TAP_CLIENT && tag < URING_TAG_CONTROL_CLIENT) {
+                client_i = tag - URING_TAG_TAP_CLIENT;
+                if (!tap_handle_client(client_i))
+                        return 0;
+                return uring_prep_poll(tap_client_fd(client_i), tag);
+        }
+
+        if (tag >= URING_TAG_CLONE_READ && tag < URING_TAG_TAP_CLIENT) {
+                if (handle_clone(&pipelinev[tag - URING_TAG_CLONE_READ]) == -1)
+                        return -1;
+                return uring_prep_poll(
+                        pipelinev[tag - URING_TAG_CLONE_READ].clone_fd, tag);
+        }
+
+        if (tag >= URING_TAG_CLONE_POLL && tag < URING_TAG_CLONE_READ)
+                return handle_uring_clone_poll(tag - URING_TAG_CLONE_POLL,
+                                               res);
+
+        if (tag >= URING_TAG_FLUSH && tag < URING_TAG_CLONE_POLL) {
+                pipeline_i = tag - URING_TAG_FLUSH;
+                uring_pipeline = &uring_pipelinev[pipeline_i];
+                if (check_uring_write(pipeline_i,
+                                      uring_pipeline->flush_eventv, res,
+                                      uring_pipeline->flush_size) == -1)
+                        return -1;
+                uring_pipeline->flush_size = 0;
+                return 0;
+        }
+
+        if (tag >= URING_TAG_CLONE && tag < URING_TAG_FLUSH) {
+                pipeline_i = tag - URING_TAG_CLONE;
+                uring_pipeline = &uring_pipelinev[pipeline_i];
+                uring_pipeline->is_clone_pending = 0;
+                return check_uring_write(pipeline_i,
+                                         uring_pipeline->clone_eventv, res,
+                                         uring_pipeline->clone_size);
+        }
+
+        /* Filter events are decided after the whole batch has been
+           handled, so that monitored events completed in the same batch
+           are taken into account. */
+        if (tag >= URING_TAG_FILTER && tag < URING_TAG_CLONE) {
+                uring_pipeline = &uring_pipelinev[tag - URING_TAG_FILTER];
+                uring_pipeline->filter_res = res;
+                uring_pipeline->is_filter_pending = 1;
+                return 0;
+        }
+
+        switch (tag) {
+        case URING_TAG_TAP_LISTEN:
+                if ((client_i = accept_tap_client()) != -1
+                    && uring_prep_poll(tap_client_fd(client_i),
+                                       URING_TAG_TAP_CLIENT + client_i) == -1)
+                        return -1;
+                return uring_prep_poll(tap_listen_fd(), URING_TAG_TAP_LISTEN);
+        case URING_TAG_CONTROL_LISTEN:
+                if ((client_i = accept_control_client()) != -1
+                    && uring_prep_poll(control_client_fd(client_i),
+                                       URING_TAG_CONTROL_CLIENT
+                                       + client_i) == -1)
+                        return -1;
+                return uring_prep_poll(control_listen_fd(),
+                                       URING_TAG_CONTROL_LISTEN);
+        case URING_TAG_INOTIFY:
+                if (handle_monitors_inotify() && arm_uring_monitors() == -1)
+                        return -1;
+                return uring_prep_poll(monitors_inotify_fd(),
+                                       URING_TAG_INOTIFY);
+        case URING_TAG_TIMERS:
+                if (handle_timers() == -1)
+                        return -1;
+                return uring_prep_poll(timers_fd(), URING_TAG_TIMERS);
+        default:
+                syslog(LOG_ERR, "io_uring: unknown completion tag %lu",
+                       (unsigned long) tag);
+                return -1;
+        }
+}
+
+/* Queues the write of expired deadlines of a pipeline, unless its
+   previous flush is still being written, in which case it is tried
+   again on the next round. */
+static int flush_uring_pipeline(int pipeline_i)
+{
+        struct pipeline       *pipeline = &pipelinev[pipeline_i];
+        struct uring_pipeline *uring_pipeline = &uring_pipelinev[pipeline_i];
+        int                    outc;
+
+        if (uring_pipeline->flush_size)
+                return 0;
+        if ((outc = expire_deadlines(pipeline,
+                                     uring_pipeline->flush_eventv)) == -1)
+                return -1;
+        if (outc == 0)
+                return 0;
+        if (settings.tap_filter)
+                tap_publish(EVDAEMON_TAP_ROLE_FILTER,
+                            uring_pipeline->flush_eventv, outc);
+        if (!outqueue_is_direct(&pipeline->outqueue)
+            || uring_pipeline->is_clone_polled)
+                return queue_uring_events(pipeline_i,
+                                          uring_pipeline->flush_eventv, outc);
+        uring_pipeline->flush_size = outc * sizeof(struct input_event);
+        if (uring_prep_write(pipeline->clone_fd, uring_pipeline->flush_eventv,
+                             uring_pipeline->flush_size,
+                             URING_TAG_FLUSH + pipeline_i, 0) == -1)
+                return -1;
+        io_stats.event_writec += outc;
+        return 0;
+}
+
+static int run_uring_loop(const sigset_t *select_sigset)
+{
+        int i;
+
+        if (uring_prep_poll(timers_fd(), URING_TAG_TIMERS) == -1)
+                return -1;
+        if (arm_uring_monitors() == -1)
+                return -1;
+        if (monitors_inotify_fd() != -1
+            && uring_prep_poll(monitors_inotify_fd(),
+                               URING_TAG_INOTIFY) == -1)
+                return -1;
+        if (tap_is_open() && uring_prep_poll(tap_listen_fd(),
+                                             URING_TAG_TAP_LISTEN) == -1)
+                return -1;
+        if (control_is_open()
+            && uring_prep_poll(control_listen_fd(),
+                               URING_TAG_CONTROL_LISTEN) == -1)
+                return -1;
+        for (i = 0; i < settings.pipelinec; ++i) {
+                if (uring_prep_poll(pipelinev[i].clone_fd,
+                                    URING_TAG_CLONE_READ + i) == -1)
+                        return -1;
+        }
+
+        while (is_running) {
+                if (update_holds_now() == -1)
+                        return -1;
+                if (update_grabs() == -1)
+                        return -1;
+                if (arm_uring_filters() == -1)
+                        return -1;
+                if (update_timers() == -1)
+                        return -1;
+
+                switch (uring_wait(NULL, select_sigset,
+                                   &handle_uring_completion)) {
+                case -1:
+                        syslog(LOG_ERR, "io_uring: %s", strerror(errno));
+                        return -1;
+                case -2:
+                        /* A completion handler failed and logged it. */
+                        return -1;
+                case 0:
+                        break;
+                default:
+                        ++io_stats.wakeupc;
+                        break;
+                }
+
+                for (i = 0; i < settings.pipelinec; ++i) {
+                        struct uring_pipeline *uring_pipeline =
+                                &uring_pipelinev[i];
+
+                        if (!uring_pipeline->is_filter_pending)
+                                continue;
+                        uring_pipeline->is_filter_pending = 0;
+                        if (handle_uring_filter(
+                                    i, uring_pipeline->filter_res) == -1)
+                                return -1;
+                }
+
+                handle_signal_requests();
+
+                if (tap_is_open())
+                        tap_notify();
+
+                for (i = 0; i < settings.pipelinec; ++i) {
+                        if (flush_uring_pipeline(i) == -1)
+                                return -1;
+                }
+        }
+        return 0;
+}
+#endif /* HAVE_LIBURING */
+
+static void log_io_stats(void)
+{
+        struct rusage usage;
+        double        cpu_seconds;
+        int           i;
+
+        if (getrusage(RUSAGE_SELF, &usage) == -1) {
+                syslog(LOG_ERR, "getrusage: %s", strerror(errno));
+                return;
+        }
+        cpu_seconds = timestamp(&usage.ru_utime) + timestamp(&usage.ru_stime);
+
+        syslog(LOG_INFO, "%s backend: %lu events read, %lu events written, "
+               "%lu wakeups, %.3f us cpu per event read, %ld kB resident "
+               "at most",
+               io_backend == IO_BACKEND_URING ? "io_uring" : "select",
+               io_stats.event_readc, io_stats.event_writec, io_stats.wakeupc,
+               io_stats.event_readc
+               ? cpu_seconds * 1000000.0 / io_stats.event_readc : 0.0,
+               usage.ru_maxrss);
+        if (io_stats.latencyc)
+                syslog(LOG_INFO, "filter latency: %.1f us mean, %.1f us at "
+                       "most", io_stats.latency_sum * 1000000.0
+                       / io_stats.latencyc, io_stats.latency_max * 1000000.0);
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                const struct outqueue *outqueue = &pipelinev[i].outqueue;
+                const struct stages   *stages = &pipelinev[i].stages;
+                int                    stage_i;
+
+                if (pipelinev[i].debounce.droppedc)
+                        syslog(LOG_INFO, "pipeline %d: %lu bounces dropped",
+                               i, pipelinev[i].debounce.droppedc);
+                if (pipelinev[i].syn_droppedc)
+                        syslog(LOG_INFO, "pipeline %d: events dropped by "
+                               "the kernel %lu times", i,
+                               pipelinev[i].syn_droppedc);
+                for (stage_i = 0; stage_i < stages->stagec; ++stage_i) {
+                        const struct stage *stage = &stages->stagev[stage_i];
+
+                        syslog(LOG_INFO, "pipeline %d: stage %s: %lu calls, "
+                               "slowest %.0f us", i, stage->stage->name,
+                               stage->batchc, stage->max_seconds * 1000000.0);
+                }
+                if (outqueue->stallc == 0)
+                        continue;
+                syslog(LOG_INFO, "pipeline %d: %lu stalled writes, "
+                       "%u events queued at most, %lu frames (%lu events) "
+                       "dropped",
+                       i, outqueue->stallc, outqueue->max_len,
+                       outqueue->dropped_framec, outqueue->dropped_eventc);
+        }
+}
+
+static void print_codes(const char *what, const char *type,
+                        const uint64_t *valuev, int max)
+{
+        int code;
+        int codec = 0;
+
+        printf("%s %s:", what, type);
+        for (code = 0; code <= max; ++code) {
+                if (bit_test64(code, valuev)) {
+                        printf(" %d", code);
+                        ++codec;
+                }
+        }
+        printf(codec ? "\n" : " none\n");
+}
+
+/* Opens the monitored devices: the named one and, if configured, all
+   the devices matching the monitor capabilities or having hold codes. */
+static int open_monitors(void)
+{
+        /* Kept for matching hotplugged devices. */
+        static const char *exclude_namev[PIPELINES_MAX * 2 + 1];
+        const char       **namep = exclude_namev;
+        unsigned int       pipeline_i;
+
+        for (pipeline_i = 0; pipeline_i < settings.pipelinec; ++pipeline_i) {
+                *namep++ = settings.pipelinev[pipeline_i].filter_name;
+                *namep++ = settings.pipelinev[pipeline_i].clone_name;
+        }
+        *namep = NULL;
+
+        return monitors_open(settings.monitor_name,
+                             settings.monitor_match_key_valuev,
+                             settings.monitor_match_rel_valuev,
+                             settings.monitor_hold_key_valuev,
+                             settings.monitor_hold_sw_valuev,
+                             exclude_namev, event_clock);
+}
+
+static int print_device(const char *role, const char *name)
+{
+        char proc_path[32];
+        char dev_path[_POSIX_PATH_MAX + 1];
+        ssize_t len;
+        int fd;
+
+        if ((fd = open_evdev_by_name(name, O_RDONLY)) == -1) {
+                printf("%s device \"%s\": %s\n", role, name, strerror(errno));
+                return -1;
+        }
+
+        snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+        if ((len = readlink(proc_path, dev_path, sizeof(dev_path) - 1)) == -1)
+                len = 0;
+        dev_path[len] = '\0';
+        close(fd);
+
+        printf("%s device \"%s\": %s\n", role, name, dev_path);
+        return 0;
+}
+
+/* Names and samples the resource use of evdaemon for the control
+   socket, so that a long-running evdaemon can be watched for leaks and
+   slowing down. All values are sampled when stat_i is 0. Returns NULL
+   past the last one. */
+static const char *resource_stat(int stat_i, double *value)
+{
+        static const char *const namev[] = {
+                "resident_kb",
+                "fds",
+                "events_read",
+                "events_written",
+                "wakeups",
+                "cpu_us_per_event",
+                "latency_us_mean",
+                "latency_us_max",
+        };
+        static double valuev[sizeof(namev) / sizeof(namev[0])];
+        struct rusage usage;
+
+        if (stat_i < 0 || stat_i >= sizeof(namev) / sizeof(namev[0]))
+                return NULL;
+
+        if (stat_i == 0) {
+                memset(valuev, 0, sizeof(valuev));
+                valuev[0] = get_resident_kb();
+                valuev[1] = count_open_fds();
+                valuev[2] = io_stats.event_readc;
+                valuev[3] = io_stats.event_writec;
+                valuev[4] = io_stats.wakeupc;
+                if (io_stats.event_readc
+                    && getrusage(RUSAGE_SELF, &usage) == 0)
+                        valuev[5] = (timestamp(&usage.ru_utime)
+                                     + timestamp(&usage.ru_stime))
+                                * 1000000.0 / io_stats.event_readc;
+                if (io_stats.latencyc)
+                        valuev[6] = io_stats.latency_sum * 1000000.0
+                                / io_stats.latencyc;
+                valuev[7] = io_stats.latency_max * 1000000.0;
+        }
+        *value = valuev[stat_i];
+        return namev[stat_i];
+}
+
+/* Logs how long starting took since start_time, a CLOCK_MONOTONIC
+   timestamp, and how much memory is resident once started. */
+static void log_startup(double start_time)
+{
+        struct timespec now;
+        struct rusage   usage;
+
+        if (clock_gettime(CLOCK_MONOTONIC, &now) == -1
+            || getrusage(RUSAGE_SELF, &usage) == -1) {
+                syslog(LOG_INFO, "started");
+                return;
+        }
+        syslog(LOG_INFO, "started in %.1f ms, %ld kB resident",
+               (now.tv_sec + now.tv_nsec / 1000000000.0 - start_time)
+               * 1000.0, usage.ru_maxrss);
+}
+
+/* Prints the decision tables of one pipeline and looks up its filter
+   device without grabbing it. Returns -1 if the device was not found. */
+static int check_pipeline(int pipeline_i)
+{
+        const struct pipeline_settings *pipeline_settings;
+        const struct coalesce          *coalesce;
+        struct stages                  *stages;
+        int                             retval = 0;
+        int                             i;
+
+        pipeline_settings = &settings.pipelinev[pipeline_i];
+        coalesce = &pipelinev[pipeline_i].coalesce;
+
+        printf("pipeline %d:\n", pipeline_i);
+        if (print_device("filter", pipeline_settings->filter_name) == -1)
+                retval = -1;
+        printf("clone device \"%s\": bustype %u vendor %u product %u "
+               "version %u\n", pipeline_settings->clone_name,
+               pipeline_settings->clone_id.bustype,
+               pipeline_settings->clone_id.vendor,
+               pipeline_settings->clone_id.product,
+               pipeline_settings->clone_id.version);
+
+        print_codes("suppress", "EV_KEY (presses)",
+                    pipeline_settings->filter_key_valuev, KEY_MAX);
+        print_codes("suppress", "EV_REL",
+                    pipeline_settings->filter_rel_valuev, REL_MAX);
+        printf("suppress for: %g s after last monitored event\n",
+               pipeline_settings->filter_duration);
+        printf("reorder window: %g s\n", pipeline_settings->filter_reorder);
+        printf("debounce window: %g s\n", pipeline_settings->filter_debounce);
+        printf("grab: %s\n", pipeline_settings->filter_passthrough
+               ? "only while suppressing" : "always");
+
+        printf("remap:");
+        for (i = 0; i < KEY_CNT; ++i) {
+                const struct remap_code *to =
+                        &pipeline_settings->filter_remap.keyv[i];
+                if (to->type)
+                        printf(" %d:%d=%u:%u", EV_KEY, i, to->type, to->code);
+        }
+        for (i = 0; i < REL_CNT; ++i) {
+                const struct remap_code *to =
+                        &pipeline_settings->filter_remap.relv[i];
+                if (to->type)
+                        printf(" %d:%d=%u:%u", EV_REL, i, to->type, to->code);
+        }
+        printf(remap_is_empty(&pipeline_settings->filter_remap)
+               ? " none\n" : "\n");
+
+        printf("coalesce:");
+        if (coalesce->interval)
+                printf(" at most %g reports per second",
+                       pipeline_settings->coalesce_rate);
+        if (coalesce->frames)
+                printf(" at most one report per %u frames", coalesce->frames);
+        printf(coalesce_is_enabled(coalesce) ? "\n" : " off\n");
+
+        /* Stages are loaded to check them, failures are logged. */
+        stages = &pipelinev[pipeline_i].stages;
+        printf("stages:");
+        if (stages_open(stages, pipeline_settings->filter_stages,
+                        pipeline_i) == -1) {
+                printf(" failed\n");
+                return -1;
+        }
+        for (i = 0; i < stages->stagec; ++i)
+                printf(" %s", stages->stagev[i].stage->name);
+        printf(stages->stagec ? "\n" : " none\n");
+        stages_close(stages);
+        return retval;
+}
+
+/* Prints the decision tables the event loop would use with the loaded
+   settings and looks up the devices without grabbing them. Returns the
+   exit status of evdaemon --check. */
+static int check_config(void)
+{
+        int exitval = EXIT_SUCCESS;
+        int i;
+
+        switch (settings.source) {
+        case SETTINGS_SOURCE_SNAPSHOT:
+                printf("settings: %s\n", PATH_CONFIG_SNAPSHOT);
+                break;
+        case SETTINGS_SOURCE_FILE:
+                printf("settings: %s\n", PATH_CONFIG_FILE);
+                break;
+        default:
+                printf("settings: %s\n", PATH_CONFIG_DIR);
+                break;
+        }
+
+        if (open_monitors() == -1) {
+                printf("monitor device \"%s\": %s\n", settings.monitor_name,
+                       strerror(errno));
+                exitval = EXIT_FAILURE;
+        }
+        for (i = 0; i < MONITORS_MAX; ++i) {
+                if (monitors_fdv[i] != -1)
+                        printf("monitor device: %s\n", monitors_path(i));
+        }
+        if (monitors_is_matching()) {
+                print_codes("match", "EV_KEY",
+                            settings.monitor_match_key_valuev, KEY_MAX);
+                print_codes("match", "EV_REL",
+                            settings.monitor_match_rel_valuev, REL_MAX);
+        }
+        print_codes("hold", "EV_KEY", settings.monitor_hold_key_valuev,
+                    KEY_MAX);
+        print_codes("hold", "EV_SW", settings.monitor_hold_sw_valuev,
+                    SW_MAX);
+        printf("holding: %s\n", monitors_is_holding() ? "yes" : "no");
+        monitors_close();
+        print_codes("monitor", "EV_KEY", settings.monitor_key_valuev,
+                    KEY_MAX);
+        print_codes("monitor", "EV_REL", settings.monitor_rel_valuev,
+                    REL_MAX);
+        printf("presets:");
+        for (i = 0; i < presetc; ++i)
+                printf(" %d:%s", i, presetv[i].name);
+        printf("\n");
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                if (check_pipeline(i) == -1)
+                        exitval = EXIT_FAILURE;
+        }
+
+        printf("footprint: %lu bytes settings, %lu bytes pipelines, "
+               "%lu bytes recorder, %lu bytes event buffers\n",
+               (unsigned long) sizeof(struct settings),
+               (unsigned long) (settings.pipelinec * sizeof(struct pipeline)),
+               (unsigned long) sizeof(recorder_ringv),
+               (unsigned long) ((EVENT_BUFC * 2 + OUT_BUFC)
+                                * sizeof(struct input_event)));
+        return exitval;
+}
+
+/* Opens and grabs the filter device of pipeline and creates its
+   clone. */
+static int open_pipeline(struct pipeline *pipeline)
+{
+        const struct pipeline_settings *pipeline_settings = pipeline->settings;
+
+        /* Writing lets LED and force feedback of the clone be passed on
+           to the device. */
+        pipeline->filter_fd = open_evdev_by_name(
+                pipeline_settings->filter_name, O_RDWR);
+        if (pipeline->filter_fd == -1) {
+                syslog(LOG_ERR, "open filter %s: %s",
+                       pipeline_settings->filter_name, strerror(errno));
+                return -1;
+        }
+
+        if (!pipeline_settings->filter_passthrough) {
+                if (ioctl(pipeline->filter_fd, EVIOCGRAB, 1) == -1) {
+                        syslog(LOG_ERR, "grab filter %s: %s",
+                               pipeline_settings->filter_name,
+                               strerror(errno));
+                        return -1;
+                }
+                pipeline->is_grabbed = 1;
+        }
+
+        pipeline->clone_fd = clone_evdev(pipeline->filter_fd,
+                                         &pipeline_settings->clone_id,
+                                         pipeline_settings->clone_name,
+                                         &pipeline_settings->filter_remap);
+        if (pipeline->clone_fd == -1) {
+                syslog(LOG_ERR, "clone_evdev: %s", strerror(errno));
+                return -1;
+        }
+
+        /* Failures are logged by stages_open(). */
+        return stages_open(&pipeline->stages,
+                           pipeline_settings->filter_stages,
+                           pipeline - pipelinev);
+}
+
+/* Makes the filter devices timestamp their events with CLOCK_MONOTONIC,
+   which does not jump when the system time is set. Kernels without
+   EVIOCSCLOCKID keep CLOCK_REALTIME for all the devices. */
+static int open_event_clock(void)
+{
+        int i;
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                if (set_evdev_clock(pipelinev[i].filter_fd,
+                                    CLOCK_MONOTONIC) == 0)
+                        continue;
+                if (i == 0 && errno == EINVAL) {
+                        syslog(LOG_INFO, "event clock: CLOCK_REALTIME");
+                        return 0;
+                }
+                syslog(LOG_ERR, "set filter clock: %s", strerror(errno));
+                return -1;
+        }
+        event_clock = CLOCK_MONOTONIC;
+        return 0;
+}
+
+/* Destroys the clone and releases the filter device of pipeline, if
+   they were opened. Returns -1 if any of it failed. */
+static int close_pipeline(struct pipeline *pipeline)
+{
+        int retval = 0;
+
+        stages_close(&pipeline->stages);
+
+        if (pipeline->clone_fd != -1) {
+                if (ioctl(pipeline->clone_fd, UI_DEV_DESTROY) == -1) {
+                        syslog(LOG_ERR, "destroy clone: %s", strerror(errno));
+                        retval = -1;
+                }
+
+                if (close(pipeline->clone_fd) == -1) {
+                        syslog(LOG_ERR, "close clone: %s", strerror(errno));
+                        retval = -1;
+                }
+                pipeline->clone_fd = -1;
+        }
+
+        if (pipeline->filter_fd != -1) {
+                if (pipeline->is_grabbed
+                    && ioctl(pipeline->filter_fd, EVIOCGRAB, 0) == -1) {
+                        syslog(LOG_ERR, "release filter: %s", strerror(errno));
+                        retval = -1;
+                }
+                pipeline->is_grabbed = 0;
+
+                if (close(pipeline->filter_fd) == -1) {
+                        syslog(LOG_ERR, "close filter: %s", strerror(errno));
+                        retval = -1;
+                }
+                pipeline->filter_fd = -1;
+        }
+        return retval;
+}
+
+/* Compiles the base configuration and every preset file into presetv.
+   The active preset stays active if it still exists. A preset file
+   which does not compile is left out. */
+static void compile_presets(void)
+{
+        char    name[PRESET_NAME_SIZE];
+        char    pattern[_POSIX_PATH_MAX + 1];
+        glob_t  g;
+        size_t  i;
+        int     retval;
+
+        strcpy(name, preset->name);
+        settings_compile_preset(&settings, &presetv[0]);
+        strcpy(presetv[0].name, "default");
+        presetc = 1;
+        preset = &presetv[0];
+
+        if (snprintf(pattern, sizeof(pattern), "%s/*", PATH_PRESETS_DIR)
+            >= sizeof(pattern))
+                return;
+        if (glob(pattern, GLOB_ERR, NULL, &g))
+                return;
+        for (i = 0; i < g.gl_pathc && presetc < PRESETS_MAX; ++i) {
+                const char *preset_name = strrchr(g.gl_pathv[i], '/') + 1;
+
+                /* Leave out the README and editor backups. */
+                if (strcmp(preset_name, "README") == 0
+                    || preset_name[strlen(preset_name) - 1] == '~')
+                        continue;
+                if (strlen(preset_name) >= PRESET_NAME_SIZE) {
+                        syslog(LOG_ERR, "preset %s: name too long",
+                               preset_name);
+                        continue;
+                }
+                retval = settings_read_preset(&settings, g.gl_pathv[i],
+                                              &presetv[presetc]);
+                if (retval) {
+                        syslog(LOG_ERR, "preset %s: %s", preset_name,
+                               retval == -1 ? strerror(errno)
+                               : settings_strerror(retval));
+                        continue;
+                }
+                strcpy(presetv[presetc].name, preset_name);
+                if (strcmp(preset_name, name) == 0)
+                        preset = &presetv[presetc];
+                ++presetc;
+        }
+        globfree(&g);
+}
+
+/* Selects the preset called name for the control socket. */
+static int select_preset_name(const char *name)
+{
+        int i;
+
+        for (i = 0; i < presetc; ++i) {
+                if (strcmp(presetv[i].name, name) == 0)
+                        return select_preset(i);
+        }
+        return -1;
+}
+
+/* Names preset_i for the control socket. Returns NULL past the last
+   preset. */
+static const char *preset_name(int preset_i, int *is_active)
+{
+        if (preset_i < 0 || preset_i >= presetc)
+                return NULL;
+        *is_active = preset == &presetv[preset_i];
+        return presetv[preset_i].name;
+}
+
+/* Returns non-zero if new_settings differ from the settings in effect in
+   what can be changed only by reopening the devices. */
+static int needs_restart(const struct settings *new_settings)
+{
+        unsigned int i;
+
+        if (new_settings->pipelinec != settings.pipelinec
+            || strcmp(new_settings->monitor_name, settings.monitor_name)
+            || memcmp(new_settings->monitor_match_key_valuev,
+                      settings.monitor_match_key_valuev,
+                      sizeof(settings.monitor_match_key_valuev))
+            || memcmp(new_settings->monitor_match_rel_valuev,
+                      settings.monitor_match_rel_valuev,
+                      sizeof(settings.monitor_match_rel_valuev))
+            || memcmp(new_settings->monitor_hold_key_valuev,
+                      settings.monitor_hold_key_valuev,
+                      sizeof(settings.monitor_hold_key_valuev))
+            || memcmp(new_settings->monitor_hold_sw_valuev,
+                      settings.monitor_hold_sw_valuev,
+                      sizeof(settings.monitor_hold_sw_valuev))
+            || new_settings->tap_filter != settings.tap_filter
+            || new_settings->tap_monitor != settings.tap_monitor)
+                return 1;
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                const struct pipeline_settings *old = &settings.pipelinev[i];
+                const struct pipeline_settings *new =
+                        &new_settings->pipelinev[i];
+
+                /* The clone is created with the remapped capabilities. */
+                if (strcmp(new->filter_name, old->filter_name)
+                    || strcmp(new->clone_name, old->clone_name)
+                    || memcmp(&new->clone_id, &old->clone_id,
+                              sizeof(old->clone_id))
+                    || memcmp(&new->filter_remap, &old->filter_remap,
+                              sizeof(old->filter_remap))
+                    || new->filter_passthrough != old->filter_passthrough
+                    || strcmp(new->filter_stages, old->filter_stages))
+                        return 1;
+        }
+        return 0;
+}
+
+/* Puts the settings saved through the control socket into effect:
+   masks, durations and coalescing change at once, other changes are
+   left for a restart. A compiled snapshot is rewritten, so that the
+   next start does not load stale settings.
+
+   Returns 0 if the new settings are in effect, 1 if they require a
+   restart and -1 on error. */
+static int apply_settings(void)
+{
+        struct settings new_settings;
+        unsigned int    i;
+        int             retval;
+
+        switch ((retval = settings_read_source(&new_settings))) {
+        case 0:
+                break;
+        case -1:
+                syslog(LOG_ERR, "settings_read: %s", strerror(errno));
+                return -1;
+        default:
+                syslog(LOG_ERR, "settings_read: %s",
+                       settings_strerror(retval));
+                return -1;
+        }
+
+        if (access(PATH_CONFIG_SNAPSHOT, F_OK) == 0
+            && (retval = settings_write_snapshot(&new_settings,
+                                                 PATH_CONFIG_SNAPSHOT))) {
+                syslog(LOG_WARNING, "write snapshot: %s",
+                       retval == -1 ? strerror(errno)
+                       : settings_strerror(retval));
+        }
+
+        if (needs_restart(&new_settings)) {
+                settings_free(&new_settings);
+                syslog(LOG_INFO, "settings changed, restart required");
+                return 1;
+        }
+
+        /* The names did not change, but the monitors keep pointers to
+           the ones in effect. */
+        free(new_settings.monitor_name);
+        new_settings.monitor_name = settings.monitor_name;
+        for (i = 0; i < settings.pipelinec; ++i) {
+                struct pipeline_settings *new = &new_settings.pipelinev[i];
+                struct pipeline_settings *old = &settings.pipelinev[i];
+
+                free(new->filter_name);
+                new->filter_name = old->filter_name;
+                pipelinev[i].debounce.window = new->filter_debounce;
+                if (new->coalesce_rate != old->coalesce_rate
+                    || new->coalesce_frames != old->coalesce_frames)
+                        coalesce_init(&pipelinev[i].coalesce,
+                                      new->coalesce_rate,
+                                      new->coalesce_frames);
+        }
+        new_settings.source = settings.source;
+        memcpy(&settings, &new_settings, sizeof(struct settings));
+        compile_presets();
+
+        syslog(LOG_INFO, "settings applied");
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        struct sigaction sigact;
+        sigset_t         blocked_sigset;
+        sigset_t         select_sigset;
+        int              exitval = EXIT_FAILURE;
+        int              syslog_options = LOG_ODELAY | LOG_PERROR;
+        int              settings_retval;
+        int              i;
+        char             status[64];
+        struct timespec  start;
+        double           start_time;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        start_time = start.tv_sec + start.tv_nsec / 1000000000.0;
+
+        parse_args(argc, argv);
+
+        for (i = 0; i < PIPELINES_MAX; ++i) {
+                pipelinev[i].filter_fd = -1;
+                pipelinev[i].clone_fd = -1;
+        }
+
+        openlog(program_invocation_short_name, syslog_options, LOG_DAEMON);
+
+        syslog(LOG_INFO, "starting");
+
+        memset(&sigact, 0, sizeof(struct sigaction));
+        sigact.sa_handler = &sigterm_handler;
+
+        if (sigfillset(&sigact.sa_mask) == -1) {
+                syslog(LOG_ERR, "sigfillset: %s", strerror(errno));
+                goto out;
+        }
+
+        if (sigaction(SIGTERM, &sigact, NULL) == -1) {
+                syslog(LOG_ERR, "sigaction SIGTERM: %s", strerror(errno));
+                goto out;
+        }
+
+        if (!is_daemon && sigaction(SIGINT, &sigact, NULL) == -1) {
+                syslog(LOG_ERR, "sigaction SIGINT: %s", strerror(errno));
+                goto out;
+        }
+
+        sigact.sa_handler = &sigusr1_handler;
+        if (is_profiling && sigaction(SIGUSR1, &sigact, NULL) == -1) {
+                syslog(LOG_ERR, "sigaction SIGUSR1: %s", strerror(errno));
+                goto out;
+        }
+
+        sigact.sa_handler = &sigusr2_handler;
+        if (sigaction(SIGUSR2, &sigact, NULL) == -1) {
+                syslog(LOG_ERR, "sigaction SIGUSR2: %s", strerror(errno));
+                goto out;
+        }
+
+        sigact.sa_handler = &sigrtmin_handler;
+        for (i = 0; i < PRESETS_MAX; ++i) {
+                if (sigaction(SIGRTMIN + i, &sigact, NULL) == -1) {
+                        syslog(LOG_ERR, "sigaction SIGRTMIN+%d: %s", i,
+                               strerror(errno));
+                        goto out;
+                }
+        }
+
+        /* The handled signals are blocked except while waiting for
+           events, which the event loops do with select_sigset, the
+           original mask. A signal arriving while the flags it sets are
+           checked is thus caught by the next wait, which it ends. */
+        if (sigemptyset(&blocked_sigset) == -1) {
+                syslog(LOG_ERR, "sigemptyset: %s", strerror(errno));
+                goto out;
+        }
+
+        if (sigaddset(&blocked_sigset, SIGTERM) == -1) {
+                syslog(LOG_ERR, "sigaddset SIGTERM: %s", strerror(errno));
+                goto out;
+        }
+
+        if (!is_daemon && sigaddset(&blocked_sigset, SIGINT) == -1) {
+                syslog(LOG_ERR, "sigaddset SIGINT: %s", strerror(errno));
+                goto out;
+        }
+
+        if (is_profiling && sigaddset(&blocked_sigset, SIGUSR1) == -1) {
+                syslog(LOG_ERR, "sigaddset SIGUSR1: %s", strerror(errno));
+                goto out;
+        }
+
+        if (sigaddset(&blocked_sigset, SIGUSR2) == -1) {
+                syslog(LOG_ERR, "sigaddset SIGUSR2: %s", strerror(errno));
+                goto out;
+        }
+
+        for (i = 0; i < PRESETS_MAX; ++i) {
+                if (sigaddset(&blocked_sigset, SIGRTMIN + i) == -1) {
+                        syslog(LOG_ERR, "sigaddset SIGRTMIN+%d: %s", i,
+                               strerror(errno));
+                        goto out;
+                }
+        }
+
+        if (sigprocmask(SIG_BLOCK, &blocked_sigset, &select_sigset) == -1) {
+                syslog(LOG_ERR, "sigprocmask: %s", strerror(errno));
+                goto out;
+        }
+
+        settings_retval = settings_read(&settings);
+        switch (settings_retval) {
+        case 0:
+                break;
+        case -1:
+                syslog(LOG_ERR, "settings_read: %s", strerror(errno));
+                goto out;
+        default:
+                syslog(LOG_ERR, "settings_read: %s",
+                       settings_strerror(settings_retval));
+                goto out;
+        }
+
+        switch (settings.source) {
+        case SETTINGS_SOURCE_SNAPSHOT:
+                syslog(LOG_INFO, "settings read from %s",
+                       PATH_CONFIG_SNAPSHOT);
+                break;
+        case SETTINGS_SOURCE_FILE:
+                syslog(LOG_INFO, "settings read from %s", PATH_CONFIG_FILE);
+                break;
+        default:
+                syslog(LOG_INFO, "settings read from %s", PATH_CONFIG_DIR);
+                break;
+        }
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                pipelinev[i].settings = &settings.pipelinev[i];
+                timer_init(&pipelinev[i].suppress_timer,
+                           &expire_suppress_timer);
+                timer_init(&pipelinev[i].debounce_timer,
+                           &expire_debounce_timer);
+                timer_init(&pipelinev[i].release_timer,
+                           &expire_release_timer);
+                timer_init(&pipelinev[i].flush_timer, &expire_flush_timer);
+                timer_init(&pipelinev[i].stage_timer, &expire_stage_timer);
+                coalesce_init(&pipelinev[i].coalesce,
+                              settings.pipelinev[i].coalesce_rate,
+                              settings.pipelinev[i].coalesce_frames);
+                debounce_init(&pipelinev[i].debounce,
+                              settings.pipelinev[i].filter_debounce);
+                outqueue_init(&pipelinev[i].outqueue);
+                feedback_init(&pipelinev[i].feedback);
+                stages_init(&pipelinev[i].stages);
+        }
+
+        compile_presets();
+
+        if (is_checking) {
+                exitval = check_config();
+                goto out;
+        }
+
+        for (i = 0; i < settings.pipelinec; ++i) {
+                if (open_pipeline(&pipelinev[i]) == -1)
+                        goto out;
+        }
+
+        /* The monitored devices are set to the clock of the filter
+           devices as they are opened. */
+        if (open_event_clock() == -1)
+                goto out;
+
+        if (open_monitors() == -1) {
+                syslog(LOG_ERR, "open monitor %s: %s", settings.monitor_name,
+                       strerror(errno));
+                goto out;
+        }
+
+        if (is_daemon && daemonize() == -1) {
+                syslog(LOG_ERR, "daemonize: %s", strerror(errno));
+                goto out;
+        }
+
+        if (timers_open(event_clock) == -1) {
+                syslog(LOG_ERR, "timerfd_create: %s", strerror(errno));
+                goto out;
+        }
+
+        if (notify_open() == -1) {
+                syslog(LOG_ERR, "notify socket: %s", strerror(errno));
+                goto out;
+        }
+
+        if (notify_watchdog_interval()) {
+                struct timeval now;
+
+                timer_init(&watchdog_timer, &expire_watchdog_timer);
+                clock_gettimeval(event_clock, &now);
+                expire_watchdog_timer(&watchdog_timer, &now);
+        }
+
+#ifdef HAVE_LIBURING
+        if (io_backend != IO_BACKEND_SELECT) {
+                if (uring_open(URING_ENTRIES) == 0) {
+                        io_backend = IO_BACKEND_URING;
+                } else if (io_backend == IO_BACKEND_URING) {
+                        syslog(LOG_ERR, "io_uring: %s", strerror(errno));
+                        goto out;
+                } else {
+                        syslog(LOG_INFO, "io_uring unavailable, "
+                               "falling back to select: %s", strerror(errno));
+                }
+        }
+#else
+        if (io_backend == IO_BACKEND_URING) {
+                syslog(LOG_ERR, "io_uring: not supported by this build");
+                goto out;
+        }
+#endif
+        if (io_backend != IO_BACKEND_URING)
+                io_backend = IO_BACKEND_SELECT;
+
+        if ((settings.tap_filter || settings.tap_monitor)
+            && tap_open(PATH_TAP_SOCKET, TAP_SLOTC) == -1) {
+                syslog(LOG_ERR, "tap %s: %s", PATH_TAP_SOCKET,
+                       strerror(errno));
+                goto out;
+        }
+
+        if (control_open(PATH_CONTROL_SOCKET, &apply_settings,
+                         &select_preset_name, &preset_name,
+                         &resource_stat) == -1)
+                syslog(LOG_WARNING, "control %s: %s", PATH_CONTROL_SOCKET,
+                       strerror(errno));
+
+        /* Counters are per-thread, so they are opened only after
+           daemonize() has forked the final process. */
+        if (is_profiling && profile_open() == -1) {
+                syslog(LOG_ERR, "profile: %s", strerror(errno));
+                goto out;
+        }
+
+        log_startup(start_time);
+
+        snprintf(status, sizeof(status), "filtering %u device(s)",
+                 settings.pipelinec);
+        if (notify_ready(status) == -1)
+                syslog(LOG_WARNING, "notify ready: %s", strerror(errno));
+
+#ifdef HAVE_LIBURING
+        if (io_backend == IO_BACKEND_URING) {
+                if (run_uring_loop(&select_sigset) == -1)
+                        goto out;
+        } else
+#endif
+        if (run_select_loop(&select_sigset) == -1)
+                goto out;
+
+        syslog(LOG_INFO, "stopped");
+        notify_stopping();
+        log_io_stats();
+        if (profile_is_enabled)
+                profile_report();
+        syslog(LOG_INFO, "terminating");
+
+        exitval = EXIT_SUCCESS;
+out:
+#ifdef HAVE_LIBURING
+        uring_close();
+#endif
+        profile_close();
+        control_close();
+        tap_close();
+        timers_close();
+        notify_close();
+        settings_free(&settings);
+
+        for (i = 0; i < PIPELINES_MAX; ++i) {
+                if (close_pipeline(&pipelinev[i]) == -1)
+                        exitval = EXIT_FAILURE;
+        }
+
+        monitors_close();
 
         syslog(LOG_INFO, "terminated");
         return exitval;
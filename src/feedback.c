@@ -0,0 +1,199 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+
+#include "feedback.h"
+
+#define FEEDBACK_BUFC 64
+
+void feedback_init(struct feedback *feedback)
+{
+        int i;
+
+        memset(feedback, 0, sizeof(struct feedback));
+        for (i = 0; i < FEEDBACK_EFFECTS_MAX; ++i)
+                feedback->effect_idv[i] = -1;
+}
+
+/* Serves an upload request of the clone by uploading the effect to the
+   real device, or updating the one uploaded before. */
+static int upload_effect(struct feedback *feedback, int clone_fd,
+                         int device_fd, int request_id)
+{
+        struct uinput_ff_upload upload;
+        struct ff_effect        effect;
+        int                     clone_id;
+
+        memset(&upload, 0, sizeof(struct uinput_ff_upload));
+        upload.request_id = request_id;
+        if (ioctl(clone_fd, UI_BEGIN_FF_UPLOAD, &upload) == -1)
+                return -1;
+
+        effect = upload.effect;
+        clone_id = effect.id;
+        if (clone_id < 0 || clone_id >= FEEDBACK_EFFECTS_MAX) {
+                upload.retval = -EINVAL;
+        } else if (effect.type == FF_PERIODIC
+                   && effect.u.periodic.waveform == FF_CUSTOM) {
+                /* Custom waveform data lives in the memory of the
+                   uploading client. */
+                upload.retval = -EINVAL;
+        } else {
+                effect.id = feedback->effect_idv[clone_id];
+                if (ioctl(device_fd, EVIOCSFF, &effect) == -1) {
+                        upload.retval = -errno;
+                } else {
+                        feedback->effect_idv[clone_id] = effect.id;
+                        ++feedback->uploadc;
+                }
+        }
+
+        return ioctl(clone_fd, UI_END_FF_UPLOAD, &upload);
+}
+
+/* Serves an erase request of the clone by erasing the effect from the
+   real device. */
+static int erase_effect(struct feedback *feedback, int clone_fd,
+                        int device_fd, int request_id)
+{
+        struct uinput_ff_erase erase;
+        int                   *device_id;
+
+        memset(&erase, 0, sizeof(struct uinput_ff_erase));
+        erase.request_id = request_id;
+        if (ioctl(clone_fd, UI_BEGIN_FF_ERASE, &erase) == -1)
+                return -1;
+
+        if (erase.effect_id < FEEDBACK_EFFECTS_MAX) {
+                device_id = &feedback->effect_idv[erase.effect_id];
+                if (*device_id != -1
+                    && ioctl(device_fd, EVIOCRMFF, *device_id) == -1) {
+                        erase.retval = -errno;
+                } else {
+                        *device_id = -1;
+                        ++feedback->erasec;
+                }
+        }
+
+        return ioctl(clone_fd, UI_END_FF_ERASE, &erase);
+}
+
+/* Translates an event written to the clone into the event to write to
+   the real device. Returns 0 if the event is not passed on. */
+static int translate_event(const struct feedback *feedback,
+                           struct input_event *event)
+{
+        switch (event->type) {
+        case EV_LED:
+        case EV_SND:
+                return 1;
+        case EV_FF:
+                /* Codes from FF_GAIN on control the device, the ones
+                   below play or stop an effect. */
+                if (event->code >= FF_GAIN)
+                        return 1;
+                if (event->code >= FEEDBACK_EFFECTS_MAX
+                    || feedback->effect_idv[event->code] == -1)
+                        return 0;
+                event->code = feedback->effect_idv[event->code];
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+/* Reads everything clients have written to the non-blocking clone_fd
+   and passes it on to the real device device_fd: LED and sound events,
+   effects to play and requests to upload or erase effects.
+
+   Returns
+
+   0 : Success.
+
+   -1 : Reading the clone failed and errno is set. Failures of the real
+   device are logged and do not count as errors, neither do they block
+   the clone: its clients are told through the request return values.
+*/
+int feedback_handle(struct feedback *feedback, int clone_fd, int device_fd)
+{
+        struct input_event eventv[FEEDBACK_BUFC];
+        struct input_event outv[FEEDBACK_BUFC];
+        ssize_t            bytes;
+        int                eventc;
+        int                outc;
+        int                i;
+
+        while (1) {
+                bytes = read(clone_fd, eventv, sizeof(eventv));
+                if (bytes == -1) {
+                        if (errno == EAGAIN)
+                                return 0;
+                        if (errno == EINTR)
+                                continue;
+                        return -1;
+                }
+                eventc = bytes / sizeof(struct input_event);
+
+                outc = 0;
+                for (i = 0; i < eventc; ++i) {
+                        struct input_event *event = &eventv[i];
+
+                        if (event->type == EV_UINPUT) {
+                                int retval = 0;
+
+                                if (event->code == UI_FF_UPLOAD)
+                                        retval = upload_effect(
+                                                feedback, clone_fd,
+                                                device_fd, event->value);
+                                else if (event->code == UI_FF_ERASE)
+                                        retval = erase_effect(
+                                                feedback, clone_fd,
+                                                device_fd, event->value);
+                                if (retval == -1)
+                                        syslog(LOG_WARNING,
+                                               "clone effect request: %s",
+                                               strerror(errno));
+                                continue;
+                        }
+                        if (translate_event(feedback, event))
+                                outv[outc++] = *event;
+                }
+
+                if (outc && write(device_fd, outv,
+                                  outc * sizeof(struct input_event)) == -1) {
+                        /* Only the first of consecutive failures is
+                           logged, a device refusing feedback would
+                           otherwise flood the log. */
+                        if (!feedback->is_write_failing)
+                                syslog(LOG_WARNING, "write feedback: %s",
+                                       strerror(errno));
+                        feedback->is_write_failing = 1;
+                        ++feedback->write_errorc;
+                } else if (outc) {
+                        feedback->is_write_failing = 0;
+                        feedback->eventc += outc;
+                }
+
+                if (eventc < FEEDBACK_BUFC)
+                        return 0;
+        }
+}
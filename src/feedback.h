@@ -0,0 +1,44 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FEEDBACK_H
+#define FEEDBACK_H
+
+#include <linux/input.h>
+
+/* Maximum number of force feedback effects a clone device holds. */
+#define FEEDBACK_EFFECTS_MAX 64
+
+/* Output written by clients to a clone device: LEDs, sounds and force
+   feedback. The clone and the real device number their effects
+   independently, effect_idv maps the ids of effects uploaded to the
+   clone to the ids the real device gave them, -1 if none.
+   is_write_failing is set while writes to the real device fail, so
+   that a failure is logged once rather than on every event. */
+struct feedback {
+        int           effect_idv[FEEDBACK_EFFECTS_MAX];
+        int           is_write_failing;
+        unsigned long eventc;
+        unsigned long write_errorc;
+        unsigned long uploadc;
+        unsigned long erasec;
+};
+
+void feedback_init(struct feedback *feedback);
+
+int feedback_handle(struct feedback *feedback, int clone_fd, int device_fd);
+
+#endif /* FEEDBACK_H */
@@ -5,3 +5,9 @@ NAMES = {
     "key": evdaemon.key.NAMES,
     "rel": evdaemon.rel.NAMES,
 }
+
+# Event type numbers as in linux/input.h.
+TYPES = {
+    "key": 0x01,
+    "rel": 0x02,
+}
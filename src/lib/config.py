@@ -4,9 +4,11 @@ from __future__ import with_statement
 import os.path
 import subprocess
 
-import evdaemon.capabilities
+import evdaemon.control
 import evdaemon.utils
 
+_dirpath = None
+
 def _query_config_dir():
     p = subprocess.Popen(["evdaemon", "--config-dir"], stdout=subprocess.PIPE,
                          stderr=subprocess.PIPE)
@@ -15,56 +17,68 @@ def _query_config_dir():
         raise RuntimeError(errmsg.strip())
     return dirpath.strip()
 
-DIRPATH = _query_config_dir()
-FILTER_DURATION_FILEPATH = os.path.join(DIRPATH, "filter", "duration")
+def dirpath():
+    """Configuration directory, only needed when evdaemon is not running
+    and the files are accessed directly."""
+    global _dirpath
+    if _dirpath is None:
+        _dirpath = _query_config_dir()
+    return _dirpath
 
 def access(mode):
-    for dirpath, _, filenames in os.walk(DIRPATH):
+    for dirpath_, _, filenames in os.walk(dirpath()):
         for filename in filenames:
-            yield os.access(os.path.join(dirpath, filename), mode)
+            yield os.access(os.path.join(dirpath_, filename), mode)
 
 def rwaccess():
+    if evdaemon.control.is_available():
+        return True, True
     return all(access(os.R_OK)), all(access(os.W_OK))
 
-def write_line(line, path):
-    with open(path, "w") as f:
+def write_line(line, name):
+    """Returns True if the value is in effect, False if evdaemon has to be
+    restarted first."""
+    if evdaemon.control.is_available():
+        return evdaemon.control.write(name, line)
+    with open(os.path.join(dirpath(), name), "w") as f:
         f.write(unicode(line))
         f.write("\n")
+    return False
 
 def write_name(name, device_role):
-    return write_line(name, os.path.join(DIRPATH, device_role, "name"))
+    return write_line(name, "%s/name" % device_role)
 
 def write_filter_duration(value):
-    return write_line(value, FILTER_DURATION_FILEPATH)
+    return write_line(value, "filter/duration")
 
 def write_clone_id(value, id_name):
-    return write_line(int(value), os.path.join(DIRPATH, "clone", "id", id_name))
+    return write_line(int(value), "clone/id/%s" % id_name)
 
-def write_capability_bits(value, device_role, capability):
-    path = os.path.join(DIRPATH, device_role, "capabilities", capability)
-    return write_line(evdaemon.utils.int_to_hexline(value), path)
+def write_capability_codes(codes, device_role, capability):
+    name = "%s/capabilities/%s" % (device_role, capability)
+    return write_line(evdaemon.utils.codes_to_hexline(codes), name)
 
-def read_line(path):
-    with open(path) as f:
+def read_line(name):
+    if evdaemon.control.is_available():
+        return evdaemon.control.read(name)
+    with open(os.path.join(dirpath(), name)) as f:
         return f.readline().strip()
 
-def read_int_line(path):
-    return int(read_line(path))
+def read_int_line(name):
+    return int(read_line(name))
 
-def read_float_line(path):
-    return float(read_line(path))
+def read_float_line(name):
+    return float(read_line(name))
 
 def read_filter_duration():
-    return read_float_line(FILTER_DURATION_FILEPATH)
+    return read_float_line("filter/duration")
 
 def read_clone_id(id_name):
-    path = os.path.join(DIRPATH, "clone", "id", id_name)
-    return read_int_line(path)
+    return read_int_line("clone/id/%s" % id_name)
 
-def read_capability_bits(device_role, capability):
-    path = os.path.join(DIRPATH, device_role, "capabilities", capability)
-    return evdaemon.utils.hexline_to_int(read_line(path), 16)
+def read_capability_codes(device_role, capability):
+    name = "%s/capabilities/%s" % (device_role, capability)
+    return evdaemon.utils.hexline_to_codes(read_line(name))
 
 def read_name(device_role):
-    path = os.path.join(DIRPATH, device_role, "name")
-    return read_line(path)
+    return read_line("%s/name" % device_role)
@@ -0,0 +1,116 @@
+from __future__ import absolute_import
+
+import os
+import socket
+import subprocess
+
+_MESSAGE_MAX = 65536
+
+_sock = None
+_socket_path = None
+
+class ControlError(Exception):
+    pass
+
+def _query_socket_path():
+    p = subprocess.Popen(["evdaemon", "--control-socket"],
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    path, errmsg = p.communicate()
+    if errmsg:
+        raise RuntimeError(errmsg.strip())
+    return path.strip()
+
+def socket_path():
+    """Control socket path, EVDAEMON_CONTROL_SOCKET if set, otherwise the
+    one evdaemon was built with."""
+    global _socket_path
+    if _socket_path is None:
+        _socket_path = os.environ.get("EVDAEMON_CONTROL_SOCKET")
+    if _socket_path is None:
+        _socket_path = _query_socket_path()
+    return _socket_path
+
+def _connect():
+    global _sock
+    if _sock is None:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        try:
+            sock.connect(socket_path())
+        except socket.error:
+            sock.close()
+            raise
+        _sock = sock
+    return _sock
+
+def _request(*words):
+    global _sock
+    sock = _connect()
+    try:
+        sock.send(" ".join(words))
+        reply = sock.recv(_MESSAGE_MAX)
+    except socket.error:
+        sock.close()
+        _sock = None
+        raise
+    if not reply:
+        sock.close()
+        _sock = None
+        raise ControlError("evdaemon closed the connection")
+    status, _, result = reply.partition("\n")
+    if status.startswith("error "):
+        raise ControlError(status[len("error "):])
+    return status, result
+
+def is_available():
+    try:
+        _connect()
+    except (socket.error, OSError, RuntimeError):
+        return False
+    return True
+
+def devices():
+    _, result = _request("devices")
+    for line in result.splitlines():
+        node, bus, vendor, product, version, types, name = line.split(" ", 6)
+        yield {
+            "node": node,
+            "bus": int(bus),
+            "vendor": int(vendor),
+            "product": int(product),
+            "version": int(version),
+            "types": set(i for i in range(64) if int(types, 16) & 1 << i),
+            "name": name,
+            }
+
+def codes(node, capability):
+    _, result = _request("codes", node, capability)
+    return [int(code) for code in result.split()]
+
+def read(name):
+    _, result = _request("get", name)
+    return result.rstrip("\n")
+
+def write(name, value):
+    """Returns True if the value is in effect, False if evdaemon has to
+    be restarted first."""
+    status, _ = _request("set", name, unicode(value))
+    return status != "ok restart"
+
+def presets(name=None):
+    """Makes preset name active, if given. Returns the names of the
+    presets and the name of the active one."""
+    _, result = _request("preset", name) if name else _request("preset")
+    names = []
+    active = None
+    for line in result.splitlines():
+        preset, _, state = line.partition(" ")
+        names.append(preset)
+        if state == "active":
+            active = preset
+    return names, active
+
+def stats():
+    """Returns the resource use statistics of evdaemon by name."""
+    _, result = _request("stats")
+    return dict((name, float(value)) for name, value
+                in (line.split(" ", 1) for line in result.splitlines()))
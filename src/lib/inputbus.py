@@ -3,61 +3,98 @@ from __future__ import with_statement
 
 import re
 
+import evdaemon.control
 import evdaemon.utils
 
 _DEVLIST_FILEPATH = "/proc/bus/input/devices"
 
-_ID_PATTERN = re.compile(r"^I: Bus=(?P<bus>[a-f\d]{4}) Vendor=(?P<vendor>[a-f\d]{4}) Product=(?P<product>[a-f\d]{4}) Version=(?P<version>[a-f\d]{4})$")
-_NAME_PATTERN = re.compile(r'^N: Name="(?P<name>.*)"$')
-_PHYS_PATTERN = re.compile(r"^P: Phys=(?P<phys>.*)$")
-_SYSFS_PATTERN = re.compile(r"^S: Sysfs=(?P<sysfs>.*)$")
-_UNIQ_PATTERN = re.compile(r"^U: Uniq=(?P<uniq>.*)$")
-_HANDLERS_PATTERN = re.compile(r"^H: Handlers=(?P<handlers>.*)$")
-_EV_PATTERN = re.compile(r"^B: EV=(?P<ev>.*)$")
-_CAPABILITY_PATTERN = re.compile(r"^B: (?P<capability>[A-Z]+)=(?P<value>.*)$")
-_BLOCK_END_PATTERN = re.compile(r"^$")
-
-def device(attr_name, attr_value, device_list_filepath=_DEVLIST_FILEPATH):
-    for device in devices(device_list_filepath).values():
-        if device[attr_name] == value:
-            yield device
+_ID_PATTERN = re.compile(r"Bus=(?P<bus>[a-f\d]+) Vendor=(?P<vendor>[a-f\d]+) Product=(?P<product>[a-f\d]+) Version=(?P<version>[a-f\d]+)")
+_LINE_PATTERN = re.compile(r"^(?P<kind>[A-Z]): (?P<key>[A-Za-z]+)=(?P<value>.*)$")
+_EVENT_HANDLER_PATTERN = re.compile(r"^event\d+$")
 
-def devices(device_list_filepath=_DEVLIST_FILEPATH):
+_WORD_BITS = evdaemon.utils.MAX_HEXLEN * 4
+
+def _new_device():
+    return {
+        "node": None,
+        "bus": None,
+        "vendor": None,
+        "product": None,
+        "version": None,
+        "name": None,
+        "phys": None,
+        "sysfs": None,
+        "uniq": None,
+        "handlers": [],
+        "types": set(),
+        "capabilities": {},
+        }
+
+def _parse_line(device, line):
+    id_match = _ID_PATTERN.search(line)
+    if line.startswith("I:") and id_match:
+        for key, value in id_match.groupdict().items():
+            device[key] = int(value, 16)
+        return
+    line_match = _LINE_PATTERN.match(line)
+    if not line_match:
+        # Lines this parser does not know about are not its business.
+        return
+    kind, key, value = line_match.group("kind", "key", "value")
+    if kind == "N" and key == "Name":
+        device["name"] = value.strip('"')
+    elif kind == "P" and key == "Phys":
+        device["phys"] = value
+    elif kind == "S" and key == "Sysfs":
+        device["sysfs"] = value
+    elif kind == "U" and key == "Uniq":
+        device["uniq"] = value
+    elif kind == "H" and key == "Handlers":
+        device["handlers"] = value.split()
+        for handler in device["handlers"]:
+            if _EVENT_HANDLER_PATTERN.match(handler):
+                device["node"] = handler
+    elif kind == "B" and key == "EV":
+        device["types"] = set(evdaemon.utils.hexline_to_codes(value,
+                                                              _WORD_BITS))
+    elif kind == "B":
+        device["capabilities"][key.lower()] = evdaemon.utils.hexline_to_codes(
+            value, _WORD_BITS)
+
+def _parse_devices(device_list_filepath):
+    result = {}
     with open(device_list_filepath) as devfile:
-        result = {}
+        device = _new_device()
         for line in devfile:
-            device = {
-                "bus": None,
-                "vendor": None,
-                "product": None,
-                "version": None,
-                "name": None,
-                "phys": None,
-                "sysfs": None,
-                "uniq": None,
-                "handlers": None,
-                "ev": None,
-                "capabilities": {}
-                }
-            try:
-                device.update(_ID_PATTERN.match(line).groupdict())
-            except AttributeError, e:
-                raise e
-            device.update(_NAME_PATTERN.match(devfile.next()).groupdict())
-            device.update(_PHYS_PATTERN.match(devfile.next()).groupdict())
-            device.update(_SYSFS_PATTERN.match(devfile.next()).groupdict())
-            device.update(_UNIQ_PATTERN.match(devfile.next()).groupdict())
-            device.update(_HANDLERS_PATTERN.match(devfile.next()).groupdict())
-            device["handlers"] = device["handlers"].split()
-            device.update(_EV_PATTERN.match(devfile.next()).groupdict())
-            device["ev"] = evdaemon.utils.hexline_to_int(device["ev"])
-            while True:
-                line = devfile.next()
-                if _BLOCK_END_PATTERN.match(line):
-                    break
-                capability_dict = _CAPABILITY_PATTERN.match(line).groupdict()
-                capability = capability_dict["capability"].lower()
-                value = evdaemon.utils.hexline_to_int(capability_dict["value"])
-                device["capabilities"][capability] = value
+            line = line.strip()
+            if line:
+                _parse_line(device, line)
+                continue
+            if device["name"] is not None:
+                result[device["name"]] = device
+            device = _new_device()
+        if device["name"] is not None:
             result[device["name"]] = device
     return result
+
+def devices(device_list_filepath=_DEVLIST_FILEPATH):
+    """Returns the input devices by name. The catalog is served by
+    evdaemon when it is running, and the capabilities of a device are
+    then fetched only when asked with capability_codes()."""
+    if not evdaemon.control.is_available():
+        return _parse_devices(device_list_filepath)
+    result = {}
+    for device in evdaemon.control.devices():
+        device["capabilities"] = {}
+        device["is_served"] = True
+        result[device["name"]] = device
+    return result
+
+def capability_codes(device, capability):
+    """Returns the codes of capability the device supports, e.g. the keys
+    it has."""
+    if (device.get("is_served")
+        and capability not in device["capabilities"]):
+        device["capabilities"][capability] = evdaemon.control.codes(
+            device["node"], capability)
+    return device["capabilities"].get(capability, [])
@@ -13,6 +13,26 @@ def hexstrs_to_int(hexstrs, max_hexlen=MAX_HEXLEN):
 def hexline_to_int(hexline, max_hexlen=MAX_HEXLEN):
     return hexstrs_to_int(hexline.split(), max_hexlen)
 
+def hexline_to_codes(hexline, word_bits=64):
+    """Returns the bit numbers set in a line of hex words, most
+    significant word first, without building one huge integer."""
+    codes = []
+    for word_i, word in enumerate(reversed(hexline.split())):
+        value = int(word, 16)
+        bit_i = 0
+        while value:
+            if value & 1:
+                codes.append(word_i * word_bits + bit_i)
+            value >>= 1
+            bit_i += 1
+    return codes
+
+def codes_to_hexline(codes, word_bits=64):
+    words = [0] * (max(codes) // word_bits + 1 if codes else 1)
+    for code in codes:
+        words[code // word_bits] |= 1 << (code % word_bits)
+    return " ".join(format(word, "x") for word in reversed(words))
+
 def int_to_hexline(value):
     hexstr = format(value, "x")
     blocks = []
@@ -0,0 +1,428 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+
+#include "monitors.h"
+#include "settings.h"
+#include "util.h"
+
+int monitors_fdv[MONITORS_MAX] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static dev_t              rdevv[MONITORS_MAX];
+static char               pathv[MONITORS_MAX][_POSIX_PATH_MAX + 1];
+static const char        *monitor_name;
+static const uint64_t    *match_keyv;
+static const uint64_t    *match_relv;
+static const uint64_t    *hold_keyv;
+static const uint64_t    *hold_swv;
+static const char *const *exclude_names;
+static int                is_matching = 0;
+static int                is_hold_set = 0;
+/* Hold codes down or on per member and their total count. */
+static uint64_t           held_keyvv[MONITORS_MAX][KEY_VALUEC];
+static uint64_t           held_swvv[MONITORS_MAX][SW_VALUEC];
+static unsigned int       heldc = 0;
+static clockid_t          event_clock = CLOCK_REALTIME;
+static int                inotify_fd = -1;
+static char               input_dir[_POSIX_PATH_MAX + 1];
+
+static int has_bits(int fd, int type, const uint64_t *valuev, int max)
+{
+        uint8_t bits[KEY_MAX / 8 + 1];
+        int     i;
+
+        memset(bits, 0, sizeof(bits));
+        if (ioctl(fd, EVIOCGBIT(type, max / 8 + 1), bits) == -1)
+                return 0;
+
+        for (i = 0; i <= max; ++i) {
+                if (bit_test64(i, valuev) && !bit_test8(i, bits))
+                        return 0;
+        }
+        return 1;
+}
+
+static int has_any_bit(int fd, int type, const uint64_t *valuev, int max)
+{
+        uint8_t bits[KEY_MAX / 8 + 1];
+        int     i;
+
+        memset(bits, 0, sizeof(bits));
+        if (ioctl(fd, EVIOCGBIT(type, max / 8 + 1), bits) == -1)
+                return 0;
+
+        for (i = 0; i <= max; ++i) {
+                if (bit_test64(i, valuev) && bit_test8(i, bits))
+                        return 1;
+        }
+        return 0;
+}
+
+static int is_wanted(int fd)
+{
+        char name[256];
+        int  i;
+
+        memset(name, 0, sizeof(name));
+        if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) == -1)
+                return 0;
+
+        if (strcmp(name, monitor_name) == 0)
+                return 1;
+
+        if (!is_matching && !is_hold_set)
+                return 0;
+
+        /* Never monitor the filter device or our own clones. */
+        for (i = 0; exclude_names[i] != NULL; ++i) {
+                if (strcmp(name, exclude_names[i]) == 0)
+                        return 0;
+        }
+
+        if (is_hold_set && (has_any_bit(fd, EV_KEY, hold_keyv, KEY_MAX)
+                            || has_any_bit(fd, EV_SW, hold_swv, SW_MAX)))
+                return 1;
+
+        return is_matching && has_bits(fd, EV_KEY, match_keyv, KEY_MAX)
+                && has_bits(fd, EV_REL, match_relv, REL_MAX);
+}
+
+/* Sets or clears bit code of a held bit array of a member, keeping
+   count of the bits set. */
+static void set_held(uint64_t *heldv, int code, int is_held)
+{
+        uint64_t bit = (uint64_t) 1 << (code % 64);
+
+        if (!(heldv[code / 64] & bit) == !is_held)
+                return;
+        heldv[code / 64] ^= bit;
+        if (is_held)
+                ++heldc;
+        else
+                --heldc;
+}
+
+/* Takes the initial state of the hold codes of a new member from the
+   device, so that e.g. a pen already in proximity holds at once. */
+static void seed_held(int monitor_i, int fd)
+{
+        uint8_t keybits[KEY_MAX / 8 + 1];
+        uint8_t swbits[SW_MAX / 8 + 1];
+        int     code;
+
+        memset(keybits, 0, sizeof(keybits));
+        memset(swbits, 0, sizeof(swbits));
+        if (ioctl(fd, EVIOCGKEY(sizeof(keybits)), keybits) == -1)
+                memset(keybits, 0, sizeof(keybits));
+        if (ioctl(fd, EVIOCGSW(sizeof(swbits)), swbits) == -1)
+                memset(swbits, 0, sizeof(swbits));
+
+        for (code = 0; code <= KEY_MAX; ++code) {
+                if (bit_test64(code, hold_keyv) && bit_test8(code, keybits))
+                        set_held(held_keyvv[monitor_i], code, 1);
+        }
+        for (code = 0; code <= SW_MAX; ++code) {
+                if (bit_test64(code, hold_swv) && bit_test8(code, swbits))
+                        set_held(held_swvv[monitor_i], code, 1);
+        }
+}
+
+/* Forgets the hold codes of a member which leaves the set. */
+static void clear_held(int monitor_i)
+{
+        int code;
+
+        for (code = 0; code <= KEY_MAX; ++code)
+                set_held(held_keyvv[monitor_i], code, 0);
+        for (code = 0; code <= SW_MAX; ++code)
+                set_held(held_swvv[monitor_i], code, 0);
+}
+
+/* Opens the event device at path and adds it to the set if it is
+   wanted and not a member already. Returns the index of the new member
+   or -1. */
+static int add(const char *path)
+{
+        struct stat st;
+        int         fd;
+        int         free_i = -1;
+        int         i;
+
+        if (stat(path, &st) == -1)
+                return -1;
+
+        for (i = 0; i < MONITORS_MAX; ++i) {
+                if (monitors_fdv[i] == -1) {
+                        if (free_i == -1)
+                                free_i = i;
+                } else if (rdevv[i] == st.st_rdev) {
+                        return -1;
+                }
+        }
+        if (free_i == -1)
+                return -1;
+
+        if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+                return -1;
+
+        /* Devices stamping events with another clock would break
+           decisions made on event timestamps. */
+        if (!is_wanted(fd) || (event_clock != CLOCK_REALTIME
+                               && set_evdev_clock(fd, event_clock) == -1)) {
+                close(fd);
+                return -1;
+        }
+
+        monitors_fdv[free_i] = fd;
+        rdevv[free_i] = st.st_rdev;
+        if (is_hold_set)
+                seed_held(free_i, fd);
+        strncpy(pathv[free_i], path, _POSIX_PATH_MAX);
+        syslog(LOG_INFO, "monitoring %s", path);
+        return free_i;
+}
+
+static int count(void)
+{
+        int monitorc = 0;
+        int i;
+
+        for (i = 0; i < MONITORS_MAX; ++i) {
+                if (monitors_fdv[i] != -1)
+                        ++monitorc;
+        }
+        return monitorc;
+}
+
+/* Opens every wanted event device. Value arrays and names must stay
+   valid until monitors_close(). If either match array has bits set,
+   devices having all of them are monitored in addition to the named
+   one, and if either hold array has bits set, devices having any of
+   them are, except devices named in the NULL-terminated exclude_namev.
+   Hotplugged devices, including the named one plugged in again, are
+   then added as they appear. Every device is set to timestamp its
+   events with clock_id.
+
+   Returns
+
+   0 : At least one device is monitored, or matching is enabled.
+
+   -1 : Syscall failed and errno is set.
+*/
+int monitors_open(const char *name, const uint64_t *match_key_valuev,
+                  const uint64_t *match_rel_valuev,
+                  const uint64_t *hold_key_valuev,
+                  const uint64_t *hold_sw_valuev,
+                  const char *const *exclude_namev, clockid_t clock_id)
+{
+        const char *devroot_path;
+        char        pattern[_POSIX_PATH_MAX + 1];
+        glob_t      g;
+        size_t      i;
+        int         orig_errno;
+
+        monitor_name = name;
+        match_keyv = match_key_valuev;
+        match_relv = match_rel_valuev;
+        hold_keyv = hold_key_valuev;
+        hold_swv = hold_sw_valuev;
+        exclude_names = exclude_namev;
+        event_clock = clock_id;
+        is_matching = 0;
+        for (i = 0; i < KEY_VALUEC; ++i)
+                is_matching |= match_keyv[i] != 0;
+        for (i = 0; i < REL_VALUEC; ++i)
+                is_matching |= match_relv[i] != 0;
+        is_hold_set = 0;
+        for (i = 0; i < KEY_VALUEC; ++i)
+                is_hold_set |= hold_keyv[i] != 0;
+        for (i = 0; i < SW_VALUEC; ++i)
+                is_hold_set |= hold_swv[i] != 0;
+
+        if ((devroot_path = get_devroot_path()) == NULL)
+                return -1;
+
+        if (snprintf(input_dir, sizeof(input_dir), "%s/input", devroot_path)
+            >= sizeof(input_dir)
+            || snprintf(pattern, sizeof(pattern), "%s/event*", input_dir)
+            >= sizeof(pattern)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+
+        /* Watch before scanning so that no device slips between. The
+           named device is watched for too, an unplugged one is added
+           again when it comes back. */
+        if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+                return -1;
+        if (inotify_add_watch(inotify_fd, input_dir,
+                              IN_CREATE | IN_ATTRIB) == -1)
+                goto err;
+
+        switch (glob(pattern, GLOB_ERR | GLOB_NOSORT, NULL, &g)) {
+        case 0:
+                break;
+        case GLOB_NOMATCH:
+                errno = ENOENT;
+                /* Fall trough. */
+        default:
+                goto err;
+        }
+        for (i = 0; i < g.gl_pathc; ++i)
+                add(g.gl_pathv[i]);
+        globfree(&g);
+
+        if (!is_matching && !is_hold_set && count() == 0) {
+                errno = ENOENT;
+                goto err;
+        }
+        return 0;
+err:
+        orig_errno = errno;
+        monitors_close();
+        errno = orig_errno;
+        return -1;
+}
+
+void monitors_close(void)
+{
+        int i;
+
+        for (i = 0; i < MONITORS_MAX; ++i) {
+                if (monitors_fdv[i] != -1)
+                        close(monitors_fdv[i]);
+                monitors_fdv[i] = -1;
+        }
+        memset(held_keyvv, 0, sizeof(held_keyvv));
+        memset(held_swvv, 0, sizeof(held_swvv));
+        heldc = 0;
+        if (inotify_fd != -1) {
+                close(inotify_fd);
+                inotify_fd = -1;
+        }
+}
+
+int monitors_is_matching(void)
+{
+        return is_matching;
+}
+
+int monitors_inotify_fd(void)
+{
+        return inotify_fd;
+}
+
+/* Adds devices which appeared in the input directory. Devices are
+   tried again when their attributes change, because udev sets the
+   permissions only after creating the node.
+
+   Returns
+
+   >=0 : Number of members added.
+
+   -1 : Syscall failed and errno is set.
+*/
+int monitors_handle_inotify(void)
+{
+        char    buf[4096]
+                __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        char    path[_POSIX_PATH_MAX + 1];
+        ssize_t bytes;
+        char   *ptr;
+        int     addedc = 0;
+
+        if ((bytes = read(inotify_fd, buf, sizeof(buf))) == -1)
+                return errno == EAGAIN ? 0 : -1;
+
+        for (ptr = buf; ptr < buf + bytes;
+             ptr += sizeof(struct inotify_event)
+                     + ((struct inotify_event *) ptr)->len) {
+                const struct inotify_event *event;
+
+                event = (const struct inotify_event *) ptr;
+                if (event->len == 0 || strncmp(event->name, "event", 5))
+                        continue;
+                if (snprintf(path, sizeof(path), "%s/%s", input_dir,
+                             event->name) >= sizeof(path))
+                        continue;
+                if (add(path) != -1)
+                        ++addedc;
+        }
+        return addedc;
+}
+
+/* Drops a member, e.g. after it was unplugged. */
+void monitors_remove(int monitor_i)
+{
+        syslog(LOG_INFO, "not monitoring %s anymore", pathv[monitor_i]);
+        close(monitors_fdv[monitor_i]);
+        monitors_fdv[monitor_i] = -1;
+        clear_held(monitor_i);
+}
+
+const char *monitors_path(int monitor_i)
+{
+        return pathv[monitor_i];
+}
+
+/* Updates the hold state of a member with one of its events. If the
+   kernel dropped events of the member, the state is taken from the
+   device again. Returns non-zero if event changes a hold code, whatever
+   its value. */
+int monitors_hold_event(int monitor_i, const struct input_event *event)
+{
+        if (!is_hold_set)
+                return 0;
+        if (event->type == EV_SYN && event->code == SYN_DROPPED) {
+                clear_held(monitor_i);
+                seed_held(monitor_i, monitors_fdv[monitor_i]);
+                return 1;
+        }
+        if (event->type == EV_KEY && event->code <= KEY_MAX
+            && bit_test64(event->code, hold_keyv)) {
+                set_held(held_keyvv[monitor_i], event->code,
+                         event->value != 0);
+                return 1;
+        }
+        if (event->type == EV_SW && event->code <= SW_MAX
+            && bit_test64(event->code, hold_swv)) {
+                set_held(held_swvv[monitor_i], event->code,
+                         event->value != 0);
+                return 1;
+        }
+        return 0;
+}
+
+/* Returns non-zero if any hold code of any member is down or on. */
+int monitors_is_holding(void)
+{
+        return heldc != 0;
+}
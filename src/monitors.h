@@ -0,0 +1,59 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MONITORS_H
+#define MONITORS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <linux/input.h>
+
+/* The set of monitored event devices: the device named in the settings
+   and, if a capability match is configured, every device having all the
+   matched capabilities. Matching devices are added as they appear.
+
+   Hold codes are keys or switches whose state, rather than their
+   events, matters, e.g. pen proximity or tablet mode. Every device
+   having any of them is monitored too, and the set keeps count of the
+   hold codes down or on across all of its members. */
+
+#define MONITORS_MAX 16
+
+extern int monitors_fdv[MONITORS_MAX];
+
+int monitors_open(const char *name, const uint64_t *match_key_valuev,
+                  const uint64_t *match_rel_valuev,
+                  const uint64_t *hold_key_valuev,
+                  const uint64_t *hold_sw_valuev,
+                  const char *const *exclude_namev, clockid_t clock_id);
+
+void monitors_close(void);
+
+int monitors_is_matching(void);
+
+int monitors_inotify_fd(void);
+
+int monitors_handle_inotify(void);
+
+void monitors_remove(int monitor_i);
+
+const char *monitors_path(int monitor_i);
+
+int monitors_hold_event(int monitor_i, const struct input_event *event);
+
+int monitors_is_holding(void);
+
+#endif /* MONITORS_H */
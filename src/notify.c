@@ -0,0 +1,149 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "notify.h"
+
+static int                notify_fd = -1;
+static struct sockaddr_un notify_addr;
+static socklen_t          notify_addrlen;
+static double             watchdog_interval = 0;
+
+/* Reads the watchdog timeout the service manager expects keep-alives
+   within. The watchdog is meant for this process only if WATCHDOG_PID
+   is unset or names it. */
+static void read_watchdog(void)
+{
+        const char *usec_str;
+        const char *pid_str;
+        char       *endptr;
+        unsigned long long usec;
+
+        if ((usec_str = getenv("WATCHDOG_USEC")) == NULL)
+                return;
+
+        pid_str = getenv("WATCHDOG_PID");
+        if (pid_str != NULL && strtol(pid_str, NULL, 10) != getpid())
+                return;
+
+        errno = 0;
+        usec = strtoull(usec_str, &endptr, 10);
+        if (errno != 0 || endptr == usec_str || usec == 0)
+                return;
+
+        /* Ping twice per timeout, like sd_watchdog_enabled() suggests. */
+        watchdog_interval = usec / 2000000.0;
+}
+
+/* Connects to the notification socket of the service manager. Must be
+   called in the final process, i.e. after daemonizing.
+
+   Returns
+
+   0 : Notifications are sent, or silently dropped if the service
+   manager did not ask for them.
+
+   -1 : $NOTIFY_SOCKET is set but unusable, errno is set.
+*/
+int notify_open(void)
+{
+        const char *path;
+        size_t      len;
+
+        if ((path = getenv("NOTIFY_SOCKET")) == NULL)
+                return 0;
+
+        len = strlen(path);
+        if ((path[0] != '/' && path[0] != '@') || len < 2
+            || len >= sizeof(notify_addr.sun_path)) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        memset(&notify_addr, 0, sizeof(notify_addr));
+        notify_addr.sun_family = AF_UNIX;
+        memcpy(notify_addr.sun_path, path, len);
+        /* Leading @ stands for the abstract namespace. */
+        if (path[0] == '@')
+                notify_addr.sun_path[0] = '\0';
+        notify_addrlen = offsetof(struct sockaddr_un, sun_path) + len;
+
+        if ((notify_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC,
+                                0)) == -1)
+                return -1;
+
+        read_watchdog();
+        return 0;
+}
+
+void notify_close(void)
+{
+        if (notify_fd != -1)
+                close(notify_fd);
+        notify_fd = -1;
+        watchdog_interval = 0;
+}
+
+/* Returns the interval in seconds keep-alives are expected at, or 0 if
+   the watchdog is not enabled. */
+double notify_watchdog_interval(void)
+{
+        return watchdog_interval;
+}
+
+static int send_state(const char *state)
+{
+        ssize_t len = strlen(state);
+
+        if (notify_fd == -1)
+                return 0;
+
+        if (sendto(notify_fd, state, len, MSG_NOSIGNAL,
+                   (const struct sockaddr *) &notify_addr,
+                   notify_addrlen) != len)
+                return -1;
+        return 0;
+}
+
+/* Tells that the clone devices exist and events are being filtered.
+   The main pid is included because the service manager only knows the
+   pid it started, which daemonizing replaces. */
+int notify_ready(const char *status)
+{
+        char state[256];
+
+        snprintf(state, sizeof(state), "READY=1\nMAINPID=%ld\nSTATUS=%s",
+                 (long) getpid(), status);
+        return send_state(state);
+}
+
+int notify_watchdog(void)
+{
+        return send_state("WATCHDOG=1");
+}
+
+int notify_stopping(void)
+{
+        return send_state("STOPPING=1");
+}
@@ -0,0 +1,37 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+/* Service manager notifications (sd_notify protocol): readiness,
+   watchdog keep-alives and shutdown. Everything is a no-op unless the
+   service manager passed $NOTIFY_SOCKET, so any program listening on a
+   local datagram socket can stand in for it. */
+
+int notify_open(void);
+
+void notify_close(void);
+
+double notify_watchdog_interval(void);
+
+int notify_ready(const char *status);
+
+int notify_watchdog(void);
+
+int notify_stopping(void);
+
+#endif /* NOTIFY_H */
@@ -0,0 +1,207 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "outqueue.h"
+
+void outqueue_init(struct outqueue *outqueue)
+{
+        memset(outqueue, 0, sizeof(struct outqueue));
+}
+
+static int is_frame_end(const struct input_event *event)
+{
+        return event->type == EV_SYN && event->code == SYN_REPORT;
+}
+
+/* Events which change state the receiver keeps, so losing them could
+   leave a key stuck. */
+static int is_stateful(const struct input_event *event)
+{
+        return event->type == EV_KEY || event->type == EV_SW;
+}
+
+static void append(struct outqueue *outqueue,
+                   const struct input_event *eventv, int eventc)
+{
+        int i;
+
+        for (i = 0; i < eventc; ++i) {
+                unsigned tail = (outqueue->head + outqueue->len)
+                        % OUTQUEUE_MAX;
+                outqueue->eventv[tail] = eventv[i];
+                ++outqueue->len;
+        }
+        if (outqueue->len > outqueue->max_len)
+                outqueue->max_len = outqueue->len;
+}
+
+/* Appends eventc events of eventv to the queue frame by frame, dropping
+   the frames which do not fit according to the overflow policy. The
+   last frame may be incomplete, its rest is expected in the next call.
+   Returns the number of events dropped. */
+int outqueue_push(struct outqueue *outqueue,
+                  const struct input_event *eventv, int eventc)
+{
+        int droppedc = 0;
+        int start = 0;
+
+        while (start < eventc) {
+                unsigned limit = OUTQUEUE_MAX - OUTQUEUE_KEY_RESERVE;
+                int      is_complete = 0;
+                int      end;
+
+                for (end = start; end < eventc; ++end) {
+                        if (is_stateful(&eventv[end]))
+                                limit = OUTQUEUE_MAX;
+                        if (is_frame_end(&eventv[end])) {
+                                is_complete = 1;
+                                ++end;
+                                break;
+                        }
+                }
+
+                /* The head of the frame was dropped in an earlier call. */
+                if (outqueue->is_dropping) {
+                        outqueue->is_dropping = !is_complete;
+                        outqueue->dropped_eventc += end - start;
+                        droppedc += end - start;
+                } else if (outqueue->len + (end - start) <= limit) {
+                        append(outqueue, &eventv[start], end - start);
+                } else {
+                        outqueue->is_dropping = !is_complete;
+                        ++outqueue->dropped_framec;
+                        outqueue->dropped_eventc += end - start;
+                        droppedc += end - start;
+                }
+                start = end;
+        }
+        return droppedc;
+}
+
+/* Writes as many queued events to fd as it accepts without blocking.
+   Returns -1 and sets errno if the write failed for another reason
+   than the device being busy. */
+int outqueue_flush(struct outqueue *outqueue, int fd)
+{
+        struct iovec iov[2];
+        unsigned     firstc;
+        ssize_t      bytes;
+        int          iovc = 1;
+
+        if (outqueue->len == 0)
+                return 0;
+
+        firstc = OUTQUEUE_MAX - outqueue->head;
+        if (firstc > outqueue->len)
+                firstc = outqueue->len;
+        iov[0].iov_base = &outqueue->eventv[outqueue->head];
+        iov[0].iov_len = firstc * sizeof(struct input_event);
+        if (firstc < outqueue->len) {
+                iov[1].iov_base = outqueue->eventv;
+                iov[1].iov_len = (outqueue->len - firstc)
+                        * sizeof(struct input_event);
+                iovc = 2;
+        }
+
+        if ((bytes = writev(fd, iov, iovc)) == -1) {
+                if (errno != EAGAIN && errno != EINTR)
+                        return -1;
+                ++outqueue->stallc;
+                return 0;
+        }
+        if (bytes % sizeof(struct input_event)) {
+                errno = EIO;
+                return -1;
+        }
+
+        bytes /= sizeof(struct input_event);
+        outqueue->head = (outqueue->head + bytes) % OUTQUEUE_MAX;
+        outqueue->len -= bytes;
+        outqueue->writec += bytes;
+        if (outqueue->len)
+                ++outqueue->stallc;
+        return 0;
+}
+
+/* Queues the events of eventv which a write of eventc events did not
+   accept, writtenc being the number it accepted. The rest of a frame
+   whose head was written is queued regardless of the overflow policy,
+   since the device already got its head. Returns the number of events
+   dropped. */
+int outqueue_push_unwritten(struct outqueue *outqueue,
+                            const struct input_event *eventv, int eventc,
+                            int writtenc)
+{
+        int end = writtenc;
+
+        outqueue->writec += writtenc;
+        if (writtenc == eventc)
+                return 0;
+        ++outqueue->stallc;
+        if (writtenc > 0 && !is_frame_end(&eventv[writtenc - 1])) {
+                while (end < eventc && !is_frame_end(&eventv[end]))
+                        ++end;
+                if (end < eventc)
+                        ++end;
+                append(outqueue, &eventv[writtenc], end - writtenc);
+        }
+        return outqueue_push(outqueue, &eventv[end], eventc - end);
+}
+
+/* Writes eventc events of eventv to fd after the queued ones. What the
+   device does not accept without blocking is queued.
+
+   Returns
+
+   >=0 : Number of events dropped by the overflow policy.
+
+   -1 : The write failed for another reason than the device being busy
+   and errno is set.
+*/
+int outqueue_write(struct outqueue *outqueue, int fd,
+                   const struct input_event *eventv, int eventc)
+{
+        ssize_t bytes;
+
+        if (eventc == 0)
+                return 0;
+
+        if (outqueue_is_direct(outqueue)) {
+                bytes = write(fd, eventv, eventc * sizeof(struct input_event));
+                if (bytes == -1) {
+                        if (errno != EAGAIN && errno != EINTR)
+                                return -1;
+                        bytes = 0;
+                }
+                if (bytes % sizeof(struct input_event)) {
+                        errno = EIO;
+                        return -1;
+                }
+                return outqueue_push_unwritten(
+                        outqueue, eventv, eventc,
+                        bytes / sizeof(struct input_event));
+        }
+
+        eventc = outqueue_push(outqueue, eventv, eventc);
+        if (outqueue_flush(outqueue, fd) == -1)
+                return -1;
+        return eventc;
+}
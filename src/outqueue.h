@@ -0,0 +1,76 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef OUTQUEUE_H
+#define OUTQUEUE_H
+
+#include <linux/input.h>
+
+/* Bounded queue of events waiting for a non-blocking clone device to
+   accept them. Events are written directly while the queue is empty
+   and no frame is being dropped, so the queue costs nothing until the
+   device stalls.
+
+   Overflow policy: frames, i.e. events up to and including SYN_REPORT,
+   are queued or dropped whole, the newest ones first. Frames carrying
+   key or switch events may use the whole queue, other frames, e.g.
+   motion, only OUTQUEUE_MAX - OUTQUEUE_KEY_RESERVE events of it, so
+   that presses and releases still fit after motion has filled the
+   queue. */
+
+#define OUTQUEUE_MAX         1024
+#define OUTQUEUE_KEY_RESERVE 256
+
+struct outqueue {
+        struct input_event eventv[OUTQUEUE_MAX];
+        unsigned           head;
+        unsigned           len;
+        int                is_dropping; /* Rest of a frame is dropped. */
+        unsigned long      writec;      /* Events written. */
+        unsigned long      stallc;      /* Writes which would block. */
+        unsigned long      dropped_framec;
+        unsigned long      dropped_eventc;
+        unsigned           max_len;
+};
+
+void outqueue_init(struct outqueue *outqueue);
+
+static inline int outqueue_is_empty(const struct outqueue *outqueue)
+{
+        return outqueue->len == 0;
+}
+
+/* Returns non-zero if events can be written to the device directly,
+   without going through outqueue_push(): nothing is queued, and the
+   rest of no dropped frame is still to come. */
+static inline int outqueue_is_direct(const struct outqueue *outqueue)
+{
+        return outqueue->len == 0 && !outqueue->is_dropping;
+}
+
+int outqueue_write(struct outqueue *outqueue, int fd,
+                   const struct input_event *eventv, int eventc);
+
+int outqueue_push(struct outqueue *outqueue,
+                  const struct input_event *eventv, int eventc);
+
+int outqueue_push_unwritten(struct outqueue *outqueue,
+                            const struct input_event *eventv, int eventc,
+                            int writtenc);
+
+int outqueue_flush(struct outqueue *outqueue, int fd);
+
+#endif /* OUTQUEUE_H */
@@ -0,0 +1,54 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROBES_H
+#define PROBES_H
+
+/* Statically defined tracepoints of the provider "evdaemon". A probe is
+   a single nop instruction until a tracer such as perf or bpftrace
+   attaches to it, e.g.
+
+     bpftrace -e 'usdt:/usr/bin/evdaemon:evdaemon:filter_suppress
+                  { printf("%d %d %d\n", arg0, arg1, arg2); }'
+
+   Event probes carry arguments type, code, value, tv_sec and tv_usec of
+   the kernel timestamp of the event. Time probes carry tv_sec and
+   tv_usec of the moment of the state change. The write probe carries
+   the number of events written. */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define PROBE_EVENT(name, event)                                        \
+        DTRACE_PROBE5(evdaemon, name, (event)->type, (event)->code,     \
+                      (event)->value, (event)->time.tv_sec,             \
+                      (event)->time.tv_usec)
+
+#define PROBE_TIME(name, tv)                                            \
+        DTRACE_PROBE2(evdaemon, name, (tv)->tv_sec, (tv)->tv_usec)
+
+#define PROBE_WRITE(name, eventc)                                       \
+        DTRACE_PROBE1(evdaemon, name, (eventc))
+
+#else
+
+#define PROBE_EVENT(name, event) do {} while (0)
+#define PROBE_TIME(name, tv) do {} while (0)
+#define PROBE_WRITE(name, eventc) do {} while (0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* PROBES_H */
@@ -0,0 +1,211 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "profile.h"
+
+#define COUNTER_CYCLES        0
+#define COUNTER_INSTRUCTIONS  1
+#define COUNTER_CACHE_MISSES  2
+#define COUNTER_CTX_SWITCHES  3
+#define COUNTER_COUNT         4
+
+static const struct {
+        uint32_t    type;
+        uint64_t    config;
+        const char *name;
+} COUNTERS[COUNTER_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache misses"},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+         "context switches"},
+};
+
+static const char *STAGE_NAMES[PROFILE_STAGE_COUNT] = {
+        "filter read",
+        "filter decide",
+        "filter write",
+        "monitor",
+};
+
+/* Layout of a PERF_FORMAT_GROUP read. */
+struct group_read {
+        uint64_t nr;
+        uint64_t valuev[COUNTER_COUNT];
+};
+
+struct stage {
+        uint64_t      valuev[COUNTER_COUNT];
+        unsigned long eventc;
+        unsigned long callc;
+};
+
+int profile_is_enabled = 0;
+
+static int          fdv[COUNTER_COUNT] = {-1, -1, -1, -1};
+static uint64_t     mark_valuev[COUNTER_COUNT];
+static struct stage stagev[PROFILE_STAGE_COUNT];
+
+static int perf_event_open(struct perf_event_attr *attr, int group_fd)
+{
+        return syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+static int open_counters(int exclude_kernel)
+{
+        int i;
+
+        for (i = 0; i < COUNTER_COUNT; ++i) {
+                struct perf_event_attr attr;
+
+                memset(&attr, 0, sizeof(struct perf_event_attr));
+                attr.size = sizeof(struct perf_event_attr);
+                attr.type = COUNTERS[i].type;
+                attr.config = COUNTERS[i].config;
+                attr.read_format = PERF_FORMAT_GROUP;
+                attr.exclude_kernel = exclude_kernel;
+                attr.exclude_hv = 1;
+                attr.disabled = i == 0;
+
+                if ((fdv[i] = perf_event_open(&attr, fdv[0])) == -1)
+                        return -1;
+        }
+        return 0;
+}
+
+/* Opens per-thread counters of the calling thread.
+
+   Returns
+
+   0 : Counters are running and profile_is_enabled is set.
+
+   -1 : perf_event_open failed and errno is set.
+*/
+int profile_open(void)
+{
+        if (open_counters(0) == -1) {
+                /* Counting kernel work needs perf_event_paranoid <= 1,
+                   user space counts are better than nothing. */
+                profile_close();
+                if (open_counters(1) == -1) {
+                        int orig_errno = errno;
+                        profile_close();
+                        errno = orig_errno;
+                        return -1;
+                }
+                syslog(LOG_INFO, "profile: counting user space only");
+        }
+
+        if (ioctl(fdv[0], PERF_EVENT_IOC_ENABLE,
+                  PERF_IOC_FLAG_GROUP) == -1) {
+                int orig_errno = errno;
+                profile_close();
+                errno = orig_errno;
+                return -1;
+        }
+        profile_is_enabled = 1;
+        return 0;
+}
+
+void profile_close(void)
+{
+        int i;
+
+        for (i = COUNTER_COUNT - 1; i >= 0; --i) {
+                if (fdv[i] != -1)
+                        close(fdv[i]);
+                fdv[i] = -1;
+        }
+        profile_is_enabled = 0;
+}
+
+static int read_counters(uint64_t *valuev)
+{
+        struct group_read group;
+
+        if (read(fdv[0], &group, sizeof(struct group_read))
+            != sizeof(struct group_read)) {
+                syslog(LOG_ERR, "profile: counter read failed, "
+                       "profiling disabled");
+                profile_close();
+                return -1;
+        }
+        memcpy(valuev, group.valuev, sizeof(group.valuev));
+        return 0;
+}
+
+/* Starts a new sequence of stages. */
+void profile_start(void)
+{
+        read_counters(mark_valuev);
+}
+
+/* Charges the counts since the previous mark to stage which handled
+   eventc events. */
+void profile_mark(int stage, unsigned long eventc)
+{
+        uint64_t valuev[COUNTER_COUNT];
+        int      i;
+
+        if (read_counters(valuev) == -1)
+                return;
+
+        for (i = 0; i < COUNTER_COUNT; ++i) {
+                stagev[stage].valuev[i] += valuev[i] - mark_valuev[i];
+                mark_valuev[i] = valuev[i];
+        }
+        stagev[stage].eventc += eventc;
+        ++stagev[stage].callc;
+}
+
+void profile_report(void)
+{
+        int i;
+
+        for (i = 0; i < PROFILE_STAGE_COUNT; ++i) {
+                const struct stage *stage = &stagev[i];
+                double              per_mevent;
+
+                if (stage->eventc == 0) {
+                        syslog(LOG_INFO, "profile %s: no events",
+                               STAGE_NAMES[i]);
+                        continue;
+                }
+                per_mevent = 1000000.0 / stage->eventc;
+
+                syslog(LOG_INFO, "profile %s: %lu events in %lu calls, "
+                       "%.1f %s per event, "
+                       "per million events: %.0f %s, %.0f %s, %.0f %s",
+                       STAGE_NAMES[i], stage->eventc, stage->callc,
+                       (double) stage->valuev[COUNTER_CYCLES] / stage->eventc,
+                       COUNTERS[COUNTER_CYCLES].name,
+                       stage->valuev[COUNTER_INSTRUCTIONS] * per_mevent,
+                       COUNTERS[COUNTER_INSTRUCTIONS].name,
+                       stage->valuev[COUNTER_CACHE_MISSES] * per_mevent,
+                       COUNTERS[COUNTER_CACHE_MISSES].name,
+                       stage->valuev[COUNTER_CTX_SWITCHES] * per_mevent,
+                       COUNTERS[COUNTER_CTX_SWITCHES].name);
+        }
+}
@@ -0,0 +1,48 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#define PROFILE_STAGE_FILTER_READ   0
+#define PROFILE_STAGE_FILTER_DECIDE 1
+#define PROFILE_STAGE_FILTER_WRITE  2
+#define PROFILE_STAGE_MONITOR       3
+#define PROFILE_STAGE_COUNT         4
+
+extern int profile_is_enabled;
+
+/* Stage marks cost nothing but a branch unless profiling is enabled. */
+#define PROFILE_START()                                                 \
+        do { if (profile_is_enabled) profile_start(); } while (0)
+
+#define PROFILE_MARK(stage, eventc)                                     \
+        do {                                                            \
+                if (profile_is_enabled)                                 \
+                        profile_mark((stage), (eventc));                \
+        } while (0)
+
+int profile_open(void);
+
+void profile_close(void);
+
+void profile_start(void);
+
+void profile_mark(int stage, unsigned long eventc);
+
+void profile_report(void);
+
+#endif /* PROFILE_H */
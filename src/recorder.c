@@ -0,0 +1,55 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <syslog.h>
+
+#include "recorder.h"
+
+static const char *DECISION_STRS[] = {
+        "monitor accept",
+        "monitor reject",
+        "filter forward",
+        "filter suppress",
+        "filter debounce",
+};
+
+struct record recorder_ringv[RECORDER_SIZE];
+unsigned long recorder_count = 0;
+
+/* Logs the recorded events from the oldest to the newest. */
+void recorder_dump(void)
+{
+        unsigned long i = 0;
+
+        if (recorder_count > RECORDER_SIZE)
+                i = recorder_count - RECORDER_SIZE;
+
+        syslog(LOG_INFO, "recorder: %lu most recent of %lu events",
+               recorder_count - i, recorder_count);
+
+        for (; i < recorder_count; ++i) {
+                const struct record *record;
+
+                record = &recorder_ringv[i & (RECORDER_SIZE - 1)];
+                syslog(LOG_INFO, "recorder: %ld.%06ld type %u code %u "
+                       "value %d filtering %u: %s",
+                       (long) record->time.tv_sec,
+                       (long) record->time.tv_usec,
+                       record->type, record->code, record->value,
+                       record->is_filtering,
+                       DECISION_STRS[record->decision]);
+        }
+}
@@ -0,0 +1,63 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <linux/input.h>
+#include <stdint.h>
+
+/* Flight recorder of the most recent events and decisions made about
+   them. Recording is a handful of stores into a static ring, the ring is
+   dumped into syslog on request. */
+
+#define RECORDER_SIZE 1024 /* Must be a power of two. */
+
+#define RECORDER_MONITOR_ACCEPT  0
+#define RECORDER_MONITOR_REJECT  1
+#define RECORDER_FILTER_FORWARD  2
+#define RECORDER_FILTER_SUPPRESS 3
+#define RECORDER_FILTER_DEBOUNCE 4
+
+struct record {
+        struct timeval time;
+        uint16_t       type;
+        uint16_t       code;
+        int32_t        value;
+        uint8_t        decision;
+        uint8_t        is_filtering;
+};
+
+extern struct record recorder_ringv[RECORDER_SIZE];
+extern unsigned long recorder_count;
+
+static inline void recorder_add(const struct input_event *event,
+                                int decision, int is_filtering)
+{
+        struct record *record;
+
+        record = &recorder_ringv[recorder_count++ & (RECORDER_SIZE - 1)];
+        record->time = event->time;
+        record->type = event->type;
+        record->code = event->code;
+        record->value = event->value;
+        record->decision = decision;
+        record->is_filtering = is_filtering;
+}
+
+void recorder_dump(void);
+
+#endif /* RECORDER_H */
@@ -0,0 +1,109 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "remap.h"
+
+static int parse_code(const char **nptr, int *typep, int *codep)
+{
+        char *endptr;
+        long type;
+        long code;
+
+        errno = 0;
+        type = strtol(*nptr, &endptr, 10);
+        if (errno || endptr == *nptr || *endptr != ':')
+                return -1;
+        *nptr = endptr + 1;
+
+        code = strtol(*nptr, &endptr, 10);
+        if (errno || endptr == *nptr)
+                return -1;
+        *nptr = endptr;
+
+        if (!(type == EV_KEY && code >= 0 && code < KEY_CNT)
+            && !(type == EV_REL && code >= 0 && code < REL_CNT))
+                return -1;
+        *typep = type;
+        *codep = code;
+        return 0;
+}
+
+/* Parses a line of space separated translations of form
+   TYPE:CODE=TYPE:CODE, with decimal numbers, e.g. `1:58=1:29' turns
+   Caps Lock into Left Control. An empty line translates nothing.
+
+   Returns
+
+   0 : Line was valid and remap was replaced.
+
+   -1 : Line was dirty: no changes were made.
+*/
+int remap_parse(struct remap *remap, const char *line)
+{
+        struct remap tmp_remap;
+        const char *nptr = line;
+
+        memset(&tmp_remap, 0, sizeof(struct remap));
+
+        while (1) {
+                struct remap_code *from;
+                int from_type, from_code;
+                int to_type, to_code;
+
+                while (isspace((unsigned char) *nptr))
+                        ++nptr;
+                if (*nptr == '\0')
+                        break;
+
+                if (parse_code(&nptr, &from_type, &from_code) == -1)
+                        return -1;
+                if (*nptr++ != '=')
+                        return -1;
+                if (parse_code(&nptr, &to_type, &to_code) == -1)
+                        return -1;
+                if (*nptr != '\0' && !isspace((unsigned char) *nptr))
+                        return -1;
+
+                from = (struct remap_code *) remap_lookup(&tmp_remap,
+                                                          from_type,
+                                                          from_code);
+                from->type = to_type;
+                from->code = to_code;
+        }
+
+        memcpy(remap, &tmp_remap, sizeof(struct remap));
+        return 0;
+}
+
+int remap_is_empty(const struct remap *remap)
+{
+        int i;
+
+        for (i = 0; i < KEY_CNT; ++i) {
+                if (remap->keyv[i].type)
+                        return 0;
+        }
+        for (i = 0; i < REL_CNT; ++i) {
+                if (remap->relv[i].type)
+                        return 0;
+        }
+        return 1;
+}
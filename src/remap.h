@@ -0,0 +1,61 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REMAP_H
+#define REMAP_H
+
+#include <linux/input.h>
+#include <stdint.h>
+
+/* Translation of EV_KEY and EV_REL events. A zero type means the code
+   is passed as is, so that a zeroed table translates nothing. */
+struct remap_code {
+        uint16_t type;
+        uint16_t code;
+};
+
+struct remap {
+        struct remap_code keyv[KEY_CNT];
+        struct remap_code relv[REL_CNT];
+};
+
+static inline const struct remap_code *remap_lookup(const struct remap *remap,
+                                                    int type, int code)
+{
+        if (type == EV_KEY && code < KEY_CNT)
+                return &remap->keyv[code];
+        if (type == EV_REL && code < REL_CNT)
+                return &remap->relv[code];
+        return NULL;
+}
+
+static inline void remap_event(const struct remap *remap,
+                               struct input_event *event)
+{
+        const struct remap_code *to;
+
+        to = remap_lookup(remap, event->type, event->code);
+        if (to != NULL && to->type) {
+                event->type = to->type;
+                event->code = to->code;
+        }
+}
+
+int remap_parse(struct remap *remap, const char *line);
+
+int remap_is_empty(const struct remap *remap);
+
+#endif /* REMAP_H */
@@ -14,17 +14,23 @@
   You should have received a copy of the GNU General Public License
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "settings.h"
 #include "util.h"
 
-#define SETTINGS_ERROR_COUNT 11
+#define SETTINGS_ERROR_COUNT 29
 static const char *SETTINGS_ERROR_STRS[SETTINGS_ERROR_COUNT] = {
         "",
         "unknown settings error",
@@ -37,331 +43,1245 @@ static const char *SETTINGS_ERROR_STRS[SETTINGS_ERROR_COUNT] = {
         "dirty or empty monitor rel file",
         "dirty or empty filter key file",
         "dirty or empty filter rel file",
+        "dirty or empty coalesce rate file",
+        "dirty or empty coalesce frames file",
+        "syntax error in configuration file",
+        "required setting missing from configuration file",
+        "device name too long for configuration snapshot",
+        "dirty or empty tap filter file",
+        "dirty or empty tap monitor file",
+        "dirty filter remap file",
+        "dirty or empty monitor match key file",
+        "dirty or empty monitor match rel file",
+        "dirty or empty filter reorder file",
+        "no such setting",
+        "dirty or empty filter passthrough file",
+        "dirty or empty filter debounce file",
+        "dirty or empty monitor hold key file",
+        "dirty or empty monitor hold sw file",
+        "setting not allowed in preset",
+        "filter stages line too long",
 };
 
-/* Returns
+/* Layout version of the configuration snapshot. Has to be increased
+   whenever struct settings changes. */
+#define SNAPSHOT_VERSION   11
+#define SNAPSHOT_NAME_SIZE 256
 
-   0 : Everything went just ok and settings were updated.
+static const char SNAPSHOT_MAGIC[8] = "evdaemon";
+
+/* Every parser returns
+
+   0 : Everything went just ok and the setting was updated.
 
    -1 : Syscall failed and errno is set: no changes were made.
 
-   >0 : One of the SETTINGS_ERROR_-prefixed values defined in settings.h.
+   >0 : errretval, the line was empty or dirty.
 */
-static int read_filter_duration(struct settings *settings)
+struct entry {
+        const char *name;
+        const char *path;
+        int (*parse)(const struct entry *entry, void *base, const char *line);
+        size_t offset;
+        size_t len;
+        int errretval;
+        int is_optional;
+        int is_pipeline;
+};
+
+/* Pipeline entries are relative to struct pipeline_settings, others to
+   struct settings. */
+#define FIELD(base, entry) ((char *) (base) + (entry)->offset)
+
+static int parse_duration(const struct entry *entry, void *base,
+                          const char *line)
 {
-        char *filter_duration_line = NULL;
-        size_t filter_duration_line_size;
         char *strtod_endptr = NULL;
         double duration;
-        int retval = -1;
 
-        if (readln(&filter_duration_line, &filter_duration_line_size,
-                   PATH_FILTER_DURATION) == -1)
+        errno = 0; /* Needed to distinguish errors from real return values. */
+        duration = strtod(line, &strtod_endptr);
+        if (errno != 0)
                 return -1;
 
+        /* No conversion was made because the file was empty or dirty. */
+        if (duration == 0 && line == strtod_endptr)
+                return entry->errretval;
+
+        *(double *) FIELD(base, entry) = duration;
+        return 0;
+}
+
+static int parse_rate(const struct entry *entry, void *base,
+                      const char *line)
+{
+        char *strtod_endptr = NULL;
+        double value;
+
         errno = 0; /* Needed to distinguish errors from real return values. */
-        duration = strtod(filter_duration_line, &strtod_endptr);
+        value = strtod(line, &strtod_endptr);
         if (errno != 0)
-                goto out;
+                return -1;
 
         /* No conversion was made because the file was empty or dirty. */
-        if (duration == 0 && filter_duration_line == strtod_endptr) {
-                retval = SETTINGS_ERROR_FILTER_DURATION;
-                goto out;
+        if (line == strtod_endptr || value < 0)
+                return entry->errretval;
+
+        *(double *) FIELD(base, entry) = value;
+        return 0;
+}
+
+static int parse_ulong(const char *line, unsigned long int max,
+                       unsigned long int *valuep, int errretval)
+{
+        char *strtoul_endptr = NULL;
+        unsigned long int value;
+
+        errno = 0; /* Needed to distinguish errors from real return values. */
+        value = strtoul(line, &strtoul_endptr, 10);
+        if (errno != 0)
+                return -1;
+
+        /* No conversion was made because the file was empty or dirty. */
+        if (value == 0 && line == strtoul_endptr)
+                return errretval;
+
+        if (value > max) {
+                errno = ERANGE;
+                return -1;
         }
 
-        settings->filter_duration = duration;
-        retval = 0;
-out:
-        free(filter_duration_line);
-        filter_duration_line = NULL;
-        return retval;
+        *valuep = value;
+        return 0;
 }
 
-static int read_filter_name(struct settings *settings)
+static int parse_uint16(const struct entry *entry, void *base,
+                        const char *line)
 {
-        if (readln(&settings->filter_name, &settings->filter_name_size,
-                   PATH_FILTER_NAME) == -1)
+        unsigned long int value;
+        int retval;
+
+        if ((retval = parse_ulong(line, USHRT_MAX, &value,
+                                  entry->errretval)) != 0)
+                return retval;
+
+        *(uint16_t *) FIELD(base, entry) = (uint16_t) value;
+        return 0;
+}
+
+static int parse_uint(const struct entry *entry, void *base,
+                      const char *line)
+{
+        unsigned long int value;
+        int retval;
+
+        if ((retval = parse_ulong(line, UINT_MAX, &value,
+                                  entry->errretval)) != 0)
+                return retval;
+
+        *(unsigned int *) FIELD(base, entry) = (unsigned int) value;
+        return 0;
+}
+
+static int parse_name(const struct entry *entry, void *base,
+                      const char *line)
+{
+        char **namep = (char **) FIELD(base, entry);
+        char *name;
+
+        if ((name = strdup(line)) == NULL)
                 return -1;
+
+        free(*namep);
+        *namep = name;
+        return 0;
+}
+
+static int parse_clone_name(const struct entry *entry, void *base,
+                            const char *line)
+{
+        char *clone_name = FIELD(base, entry);
+
+        memset(clone_name, 0, UINPUT_MAX_NAME_SIZE);
+        strncpy(clone_name, line, UINPUT_MAX_NAME_SIZE - 1);
         return 0;
 }
 
-static int read_monitor_name(struct settings *settings)
+static int parse_valuev(const struct entry *entry, void *base,
+                        const char *line)
 {
-        if (readln(&settings->monitor_name, &settings->monitor_name_size,
-                   PATH_MONITOR_NAME) == -1)
+        switch (strtovaluev((uint64_t *) FIELD(base, entry), entry->len,
+                            line)) {
+        case 0:
+                return 0;
+        case -1:
                 return -1;
+        case -2:
+        case -3:
+                return entry->errretval;
+        default:
+                return SETTINGS_ERROR_UNKNOWN;
+        }
+}
+
+static int parse_remap(const struct entry *entry, void *base,
+                       const char *line)
+{
+        if (remap_parse((struct remap *) FIELD(base, entry), line) == -1)
+                return entry->errretval;
         return 0;
 }
 
-static int read_clone_name(struct settings *settings)
+static int parse_stages(const struct entry *entry, void *base,
+                        const char *line)
 {
-        FILE *file;
-        size_t chars_fread;
-        int retval = -1;
-        int orig_errno;
+        char *stages = FIELD(base, entry);
+
+        if (strlen(line) >= FILTER_STAGES_SIZE)
+                return entry->errretval;
+        strcpy(stages, line);
+        return 0;
+}
+
+#define ENTRY(name, path, parse, member, len, errretval, is_optional)   \
+        {name, path, parse, offsetof(struct settings, member), len,     \
+         errretval, is_optional, 0}
+
+#define PIPELINE_ENTRY(name, path, parse, member, len, errretval,       \
+                       is_optional)                                     \
+        {name, path, parse, offsetof(struct pipeline_settings, member), \
+         len, errretval, is_optional, 1}
+
+static const struct entry ENTRIES[] = {
+        PIPELINE_ENTRY("filter/duration", PATH_FILTER_DURATION,
+                       parse_duration, filter_duration, 0,
+                       SETTINGS_ERROR_FILTER_DURATION, 0),
+        PIPELINE_ENTRY("filter/name", PATH_FILTER_NAME, parse_name,
+                       filter_name, 0, SETTINGS_ERROR_UNKNOWN, 0),
+        ENTRY("monitor/name", PATH_MONITOR_NAME, parse_name,
+              monitor_name, 0, SETTINGS_ERROR_UNKNOWN, 0),
+        PIPELINE_ENTRY("clone/name", PATH_CLONE_NAME, parse_clone_name,
+                       clone_name, 0, SETTINGS_ERROR_UNKNOWN, 0),
+        PIPELINE_ENTRY("clone/id/bustype", PATH_CLONE_ID_BUSTYPE,
+                       parse_uint16, clone_id.bustype, 0,
+                       SETTINGS_ERROR_CLONE_ID_BUSTYPE, 0),
+        PIPELINE_ENTRY("clone/id/vendor", PATH_CLONE_ID_VENDOR,
+                       parse_uint16, clone_id.vendor, 0,
+                       SETTINGS_ERROR_CLONE_ID_VENDOR, 0),
+        PIPELINE_ENTRY("clone/id/product", PATH_CLONE_ID_PRODUCT,
+                       parse_uint16, clone_id.product, 0,
+                       SETTINGS_ERROR_CLONE_ID_PRODUCT, 0),
+        PIPELINE_ENTRY("clone/id/version", PATH_CLONE_ID_VERSION,
+                       parse_uint16, clone_id.version, 0,
+                       SETTINGS_ERROR_CLONE_ID_VERSION, 0),
+        ENTRY("monitor/capabilities/key", PATH_MONITOR_CAPABILITIES_KEY,
+              parse_valuev, monitor_key_valuev, KEY_VALUEC,
+              SETTINGS_ERROR_DIRTY_MONITOR_KEY, 0),
+        ENTRY("monitor/capabilities/rel", PATH_MONITOR_CAPABILITIES_REL,
+              parse_valuev, monitor_rel_valuev, REL_VALUEC,
+              SETTINGS_ERROR_DIRTY_MONITOR_REL, 0),
+        PIPELINE_ENTRY("filter/capabilities/key",
+                       PATH_FILTER_CAPABILITIES_KEY, parse_valuev,
+                       filter_key_valuev, KEY_VALUEC,
+                       SETTINGS_ERROR_DIRTY_FILTER_KEY, 0),
+        PIPELINE_ENTRY("filter/capabilities/rel",
+                       PATH_FILTER_CAPABILITIES_REL, parse_valuev,
+                       filter_rel_valuev, REL_VALUEC,
+                       SETTINGS_ERROR_DIRTY_FILTER_REL, 0),
+        /* Optional settings keep their default values if they are not
+           set, so that configurations of older versions remain valid. */
+        PIPELINE_ENTRY("filter/coalesce/rate", PATH_FILTER_COALESCE_RATE,
+                       parse_rate, coalesce_rate, 0,
+                       SETTINGS_ERROR_COALESCE_RATE, 1),
+        PIPELINE_ENTRY("filter/coalesce/frames",
+                       PATH_FILTER_COALESCE_FRAMES, parse_uint,
+                       coalesce_frames, 0, SETTINGS_ERROR_COALESCE_FRAMES,
+                       1),
+        ENTRY("tap/filter", PATH_TAP_FILTER, parse_uint, tap_filter, 0,
+              SETTINGS_ERROR_TAP_FILTER, 1),
+        ENTRY("tap/monitor", PATH_TAP_MONITOR, parse_uint, tap_monitor, 0,
+              SETTINGS_ERROR_TAP_MONITOR, 1),
+        PIPELINE_ENTRY("filter/remap", PATH_FILTER_REMAP, parse_remap,
+                       filter_remap, 0, SETTINGS_ERROR_FILTER_REMAP, 1),
+        PIPELINE_ENTRY("filter/reorder", PATH_FILTER_REORDER, parse_rate,
+                       filter_reorder, 0, SETTINGS_ERROR_FILTER_REORDER, 1),
+        PIPELINE_ENTRY("filter/passthrough", PATH_FILTER_PASSTHROUGH,
+                       parse_uint, filter_passthrough, 0,
+                       SETTINGS_ERROR_FILTER_PASSTHROUGH, 1),
+        PIPELINE_ENTRY("filter/debounce", PATH_FILTER_DEBOUNCE, parse_rate,
+                       filter_debounce, 0, SETTINGS_ERROR_FILTER_DEBOUNCE,
+                       1),
+        ENTRY("monitor/match/key", PATH_MONITOR_MATCH_KEY, parse_valuev,
+              monitor_match_key_valuev, KEY_VALUEC,
+              SETTINGS_ERROR_MONITOR_MATCH_KEY, 1),
+        ENTRY("monitor/match/rel", PATH_MONITOR_MATCH_REL, parse_valuev,
+              monitor_match_rel_valuev, REL_VALUEC,
+              SETTINGS_ERROR_MONITOR_MATCH_REL, 1),
+        ENTRY("monitor/hold/key", PATH_MONITOR_HOLD_KEY, parse_valuev,
+              monitor_hold_key_valuev, KEY_VALUEC,
+              SETTINGS_ERROR_MONITOR_HOLD_KEY, 1),
+        ENTRY("monitor/hold/sw", PATH_MONITOR_HOLD_SW, parse_valuev,
+              monitor_hold_sw_valuev, SW_VALUEC,
+              SETTINGS_ERROR_MONITOR_HOLD_SW, 1),
+        PIPELINE_ENTRY("filter/stages", PATH_FILTER_STAGES, parse_stages,
+                       filter_stages, 0, SETTINGS_ERROR_FILTER_STAGES, 1),
+};
+
+#define ENTRY_COUNT (sizeof(ENTRIES) / sizeof(ENTRIES[0]))
+
+static void *entry_base(const struct entry *entry, struct settings *settings,
+                        unsigned int pipeline_i)
+{
+        if (entry->is_pipeline)
+                return &settings->pipelinev[pipeline_i];
+        return settings;
+}
 
-        if ((file = fopen(PATH_CLONE_NAME, "r")) == NULL)
+/* Formats the path of the file of entry in the configuration directory
+   into path, which must have room for _POSIX_PATH_MAX + 1 chars. */
+static int format_entry_path(char *path, const struct entry *entry,
+                             unsigned int pipeline_i)
+{
+        if (pipeline_i == 0) {
+                if (strlen(entry->path) > _POSIX_PATH_MAX) {
+                        errno = ENAMETOOLONG;
+                        return -1;
+                }
+                strcpy(path, entry->path);
+                return 0;
+        }
+        if (snprintf(path, _POSIX_PATH_MAX + 1, "%s/%u/%s",
+                     PATH_PIPELINES_DIR, pipeline_i,
+                     entry->name) > _POSIX_PATH_MAX) {
+                errno = ENAMETOOLONG;
                 return -1;
+        }
+        return 0;
+}
+
+/* Reads the entries of one pipeline from the configuration directory,
+   all the entries in the first pipeline and only the pipeline entries
+   in the others. */
+static int read_dir_entries(struct settings *settings,
+                            unsigned int pipeline_i)
+{
+        char *line = NULL;
+        size_t line_size = 0;
+        char path[_POSIX_PATH_MAX + 1];
+        size_t i;
+        int retval = 0;
+
+        for (i = 0; i < ENTRY_COUNT; ++i) {
+                const struct entry *entry = &ENTRIES[i];
+
+                if (pipeline_i && !entry->is_pipeline)
+                        continue;
+                if (format_entry_path(path, entry, pipeline_i) == -1) {
+                        retval = -1;
+                        break;
+                }
+
+                if (readln(&line, &line_size, path) == -1) {
+                        if (errno == ENOENT && entry->is_optional)
+                                continue;
+                        retval = -1;
+                        break;
+                }
+                if ((retval = entry->parse(entry,
+                                           entry_base(entry, settings,
+                                                      pipeline_i),
+                                           line)) != 0)
+                        break;
+        }
+
+        free(line);
+        line = NULL;
+        return retval;
+}
+
+/* Reads settings from the configuration directory, one file per
+   setting. Additional pipelines are read from numbered directories
+   under the pipelines directory, up to the first missing one. */
+static int read_dir(struct settings *settings)
+{
+        char dir[_POSIX_PATH_MAX + 1];
+        unsigned int pipeline_i;
+        int retval;
 
-        chars_fread = fread(settings->clone_name, sizeof(char),
-                            UINPUT_MAX_NAME_SIZE - 1, file);
+        if ((retval = read_dir_entries(settings, 0)) != 0)
+                return retval;
+        settings->pipelinec = 1;
+
+        for (pipeline_i = 1; pipeline_i < PIPELINES_MAX; ++pipeline_i) {
+                if (snprintf(dir, sizeof(dir), "%s/%u", PATH_PIPELINES_DIR,
+                             pipeline_i) >= sizeof(dir)) {
+                        errno = ENAMETOOLONG;
+                        return -1;
+                }
+                if (access(dir, F_OK) == -1) {
+                        if (errno == ENOENT)
+                                break;
+                        return -1;
+                }
+                if ((retval = read_dir_entries(settings,
+                                               pipeline_i)) != 0)
+                        return retval;
+                settings->pipelinec = pipeline_i + 1;
+        }
+        return 0;
+}
+
+static char *strip(char *str)
+{
+        char *end;
+
+        while (isspace((unsigned char) *str))
+                ++str;
+        end = str + strlen(str);
+        while (end > str && isspace((unsigned char) end[-1]))
+                *--end = '\0';
+        return str;
+}
+
+/* Reads the whole file at path into a malloced, nul-terminated buffer
+   with a single read. Returns NULL and sets errno on failure. */
+static char *read_file(const char *path)
+{
+        struct stat st;
+        char *buf = NULL;
+        ssize_t bytes;
+        int orig_errno;
+        int fd;
 
-        if (ferror(file))
+        if ((fd = open(path, O_RDONLY)) == -1)
+                return NULL;
+
+        if (fstat(fd, &st) == -1)
                 goto out;
 
-        /* Remove trailing newline character if it exists. */
-        if (settings->clone_name[chars_fread-1] == '\n')
-                settings->clone_name[chars_fread-1] = '\0';
+        if ((buf = (char *) malloc(st.st_size + 1)) == NULL)
+                goto out;
 
-        retval = 0;
+        if ((bytes = read(fd, buf, st.st_size)) == -1) {
+                free(buf);
+                buf = NULL;
+                goto out;
+        }
+        buf[bytes] = '\0';
 out:
         orig_errno = errno;
-        fclose(file);
+        close(fd);
         errno = orig_errno;
+        return buf;
+}
+
+/* Splits the pipeline prefix `pipelines/<n>/' off name. Returns the
+   pipeline index, 0 if there is no prefix or -1 if the prefix is
+   invalid. */
+static int split_pipeline(char **namep)
+{
+        const char prefix[] = "pipelines/";
+        char *end;
+        unsigned long int pipeline_i;
+
+        if (strncmp(*namep, prefix, sizeof(prefix) - 1))
+                return 0;
+
+        pipeline_i = strtoul(*namep + sizeof(prefix) - 1, &end, 10);
+        if (end == *namep + sizeof(prefix) - 1 || *end != '/'
+            || pipeline_i == 0 || pipeline_i >= PIPELINES_MAX)
+                return -1;
+
+        *namep = end + 1;
+        return (int) pipeline_i;
+}
+
+/* Reads settings from the single configuration file in one pass. Lines
+   are of form `name = value', where name is the path of the
+   corresponding file relative to the configuration directory. Empty
+   lines and lines starting with `#' are ignored. */
+static int read_file_settings(struct settings *settings, const char *path)
+{
+        char *buf;
+        char *line;
+        char *next;
+        unsigned char is_setv[PIPELINES_MAX][ENTRY_COUNT];
+        unsigned int pipeline_i;
+        size_t i;
+        int retval = 0;
+
+        if ((buf = read_file(path)) == NULL)
+                return -1;
+
+        memset(is_setv, 0, sizeof(is_setv));
+        settings->pipelinec = 1;
+
+        for (line = buf; line != NULL && retval == 0; line = next) {
+                char *name;
+                char *value;
+                int split_i;
+
+                if ((next = strchr(line, '\n')) != NULL)
+                        *next++ = '\0';
+
+                name = strip(line);
+                if (*name == '\0' || *name == '#')
+                        continue;
+
+                if ((value = strchr(name, '=')) == NULL) {
+                        retval = SETTINGS_ERROR_CONFIG_SYNTAX;
+                        break;
+                }
+                *value++ = '\0';
+                name = strip(name);
+                value = strip(value);
+
+                if ((split_i = split_pipeline(&name)) == -1) {
+                        retval = SETTINGS_ERROR_CONFIG_SYNTAX;
+                        break;
+                }
+                pipeline_i = split_i;
+
+                for (i = 0; i < ENTRY_COUNT; ++i) {
+                        if (strcmp(name, ENTRIES[i].name) == 0)
+                                break;
+                }
+                if (i == ENTRY_COUNT || is_setv[pipeline_i][i]
+                    || (pipeline_i && !ENTRIES[i].is_pipeline)) {
+                        retval = SETTINGS_ERROR_CONFIG_SYNTAX;
+                        break;
+                }
+                is_setv[pipeline_i][i] = 1;
+                if (pipeline_i >= settings->pipelinec)
+                        settings->pipelinec = pipeline_i + 1;
+                retval = ENTRIES[i].parse(&ENTRIES[i],
+                                          entry_base(&ENTRIES[i], settings,
+                                                     pipeline_i),
+                                          value);
+        }
+
+        for (pipeline_i = 0; pipeline_i < settings->pipelinec; ++pipeline_i) {
+                for (i = 0; retval == 0 && i < ENTRY_COUNT; ++i) {
+                        if (pipeline_i && !ENTRIES[i].is_pipeline)
+                                continue;
+                        if (!is_setv[pipeline_i][i]
+                            && !ENTRIES[i].is_optional)
+                                retval = SETTINGS_ERROR_CONFIG_MISSING;
+                }
+        }
+
+        free(buf);
+        buf = NULL;
         return retval;
 }
 
-static int read_clone_id_member(uint16_t *valuep, const char *path,
-                                int errretval)
+static uint32_t checksum(const void *data, size_t size)
 {
-        char *line = NULL;
-        size_t line_size;
-        char *strtoul_endptr = NULL;
-        unsigned long int value;
+        const unsigned char *bytes = (const unsigned char *) data;
+        uint32_t hash = 2166136261u; /* FNV-1a */
+        size_t i;
+
+        for (i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+/* A snapshot records what it was compiled from, so that only those
+   sources have to be checked for changes when it is loaded: source is
+   SETTINGS_SOURCE_FILE or SETTINGS_SOURCE_DIR, and with the latter
+   is_presentv tells which of the setting files of each pipeline
+   existed. */
+struct snapshot {
+        char            magic[8];
+        uint32_t        version;
+        uint32_t        size;
+        uint32_t        checksum;
+        uint32_t        reserved;
+        char            monitor_name[SNAPSHOT_NAME_SIZE];
+        char            filter_namev[PIPELINES_MAX][SNAPSHOT_NAME_SIZE];
+        uint32_t        source;
+        unsigned char   is_presentv[PIPELINES_MAX][ENTRY_COUNT];
+        struct settings settings;
+};
+
+#define SNAPSHOT_BODY(ptr) ((const char *) (ptr)                         \
+                            + offsetof(struct snapshot, monitor_name))
+#define SNAPSHOT_BODY_SIZE (sizeof(struct snapshot)                       \
+                            - offsetof(struct snapshot, monitor_name))
+
+static int is_newer(const struct timespec *time, const struct timespec *than)
+{
+        return time->tv_sec > than->tv_sec
+                || (time->tv_sec == than->tv_sec
+                    && time->tv_nsec > than->tv_nsec);
+}
+
+/* Returns non-zero if the sources snapshot was compiled from were
+   changed after mtime, or cannot be checked. The single configuration
+   file costs one stat. In the configuration directory, only the setting
+   files of the pipelines in the snapshot are checked, one stat each, and
+   the directory of the next pipeline, which would add one. */
+static int is_snapshot_stale(const struct snapshot *snapshot,
+                             const struct timespec *mtime)
+{
+        char path[_POSIX_PATH_MAX + 1];
+        struct stat st;
+        unsigned int pipeline_i;
+        size_t i;
+
+        if (stat(PATH_CONFIG_FILE, &st) == 0)
+                return snapshot->source != SETTINGS_SOURCE_FILE
+                        || is_newer(&st.st_mtim, mtime);
+        if (errno != ENOENT || snapshot->source != SETTINGS_SOURCE_DIR)
+                return 1;
+
+        for (pipeline_i = 0; pipeline_i < snapshot->settings.pipelinec;
+             ++pipeline_i) {
+                for (i = 0; i < ENTRY_COUNT; ++i) {
+                        if (pipeline_i && !ENTRIES[i].is_pipeline)
+                                continue;
+                        if (format_entry_path(path, &ENTRIES[i],
+                                              pipeline_i) == -1)
+                                return 1;
+                        if (stat(path, &st) == -1) {
+                                if (errno != ENOENT
+                                    || snapshot->is_presentv[pipeline_i][i])
+                                        return 1;
+                        } else if (!snapshot->is_presentv[pipeline_i][i]
+                                   || is_newer(&st.st_mtim, mtime)) {
+                                return 1;
+                        }
+                }
+        }
+
+        if (pipeline_i < PIPELINES_MAX) {
+                if (snprintf(path, sizeof(path), "%s/%u", PATH_PIPELINES_DIR,
+                             pipeline_i) >= sizeof(path))
+                        return 1;
+                if (access(path, F_OK) == 0 || errno != ENOENT)
+                        return 1;
+        }
+        return 0;
+}
+
+/* Returns
+
+   0 : Settings were read from a valid snapshot.
+
+   1 : There is no usable snapshot: it does not exist, it was written by
+   another version or it is older than the configuration it was compiled
+   from.
+
+   -1 : Syscall failed and errno is set.
+*/
+static int read_snapshot(struct settings *settings)
+{
+        const struct snapshot *snapshot;
+        struct stat st;
+        unsigned int pipeline_i;
+        void *addr;
         int retval = -1;
+        int orig_errno;
+        int fd;
 
-        if (readln(&line, &line_size, path) == -1)
-                return -1;
+        if ((fd = open(PATH_CONFIG_SNAPSHOT, O_RDONLY)) == -1)
+                return errno == ENOENT ? 1 : -1;
 
-        errno = 0; /* Needed to distinguish errors from real return values. */
-        value = strtoul(line, &strtoul_endptr, 10);
-        if (errno != 0)
+        if (fstat(fd, &st) == -1)
                 goto out;
 
-        /* No conversion was made because the file was empty or dirty. */
-        if (value == 0 && line == strtoul_endptr) {
-                retval = errretval;
+        if (st.st_size != sizeof(struct snapshot)) {
+                retval = 1;
                 goto out;
         }
 
-        if (value > USHRT_MAX) {
-                errno = ERANGE;
+        addr = mmap(NULL, sizeof(struct snapshot), PROT_READ, MAP_PRIVATE,
+                    fd, 0);
+        if (addr == MAP_FAILED)
                 goto out;
+        snapshot = (const struct snapshot *) addr;
+
+        if (memcmp(snapshot->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))
+            || snapshot->version != SNAPSHOT_VERSION
+            || snapshot->size != sizeof(struct snapshot)
+            || snapshot->checksum != checksum(SNAPSHOT_BODY(snapshot),
+                                              SNAPSHOT_BODY_SIZE)
+            || snapshot->settings.pipelinec < 1
+            || snapshot->settings.pipelinec > PIPELINES_MAX
+            || is_snapshot_stale(snapshot, &st.st_mtim)) {
+                retval = 1;
+                goto unmap;
+        }
+
+        memcpy(settings, &snapshot->settings, sizeof(struct settings));
+        settings->monitor_name = strndup(snapshot->monitor_name,
+                                         SNAPSHOT_NAME_SIZE);
+        if (settings->monitor_name == NULL)
+                goto unmap;
+        for (pipeline_i = 0; pipeline_i < settings->pipelinec; ++pipeline_i) {
+                struct pipeline_settings *pipeline;
+
+                pipeline = &settings->pipelinev[pipeline_i];
+                pipeline->filter_name = strndup(
+                        snapshot->filter_namev[pipeline_i],
+                        SNAPSHOT_NAME_SIZE);
+                if (pipeline->filter_name == NULL)
+                        goto unmap;
         }
 
-        *valuep = (uint16_t) value;
         retval = 0;
+unmap:
+        orig_errno = errno;
+        munmap(addr, sizeof(struct snapshot));
+        errno = orig_errno;
 out:
-        free(line);
-        line = NULL;
+        orig_errno = errno;
+        close(fd);
+        errno = orig_errno;
         return retval;
 }
 
-static int read_clone_id(struct input_id *clone_id)
+/* Reads settings from their sources, skipping the snapshot: from the
+   single configuration file if it exists, otherwise from the
+   configuration directory. Returns like settings_read(). */
+int settings_read_source(struct settings *settings)
 {
         int retval;
-        struct input_id tmp_clone_id;
+        struct settings tmp_settings;
 
-        memset(&tmp_clone_id, 0, sizeof(struct input_id));
+        memset(&tmp_settings, 0, sizeof(struct settings));
 
-        retval = read_clone_id_member(&tmp_clone_id.bustype,
-                                      PATH_CLONE_ID_BUSTYPE,
-                                      SETTINGS_ERROR_CLONE_ID_BUSTYPE);
+        if (access(PATH_CONFIG_FILE, F_OK) == 0) {
+                retval = read_file_settings(&tmp_settings, PATH_CONFIG_FILE);
+                tmp_settings.source = SETTINGS_SOURCE_FILE;
+        } else {
+                retval = read_dir(&tmp_settings);
+                tmp_settings.source = SETTINGS_SOURCE_DIR;
+        }
         if (retval != 0)
-                return retval;
+                goto err;
 
-        retval = read_clone_id_member(&tmp_clone_id.vendor,
-                                      PATH_CLONE_ID_VENDOR,
-                                      SETTINGS_ERROR_CLONE_ID_VENDOR);
-        if (retval != 0)
-                return retval;
+        /* Safe to copy fresh settings because no error was detected.*/
+        memcpy(settings, &tmp_settings, sizeof(struct settings));
+        return 0;
+err:
+        settings_free(&tmp_settings);
+        return retval;
+}
 
-        retval = read_clone_id_member(&tmp_clone_id.product,
-                                      PATH_CLONE_ID_PRODUCT,
-                                      SETTINGS_ERROR_CLONE_ID_PRODUCT);
-        if (retval != 0)
-                return retval;
+/* Returns
 
-        retval = read_clone_id_member(&tmp_clone_id.version,
-                                      PATH_CLONE_ID_VERSION,
-                                      SETTINGS_ERROR_CLONE_ID_VERSION);
-        if (retval != 0)
-                return retval;
+   0 : Everything went just ok and settings were updated.
 
-        memcpy(clone_id, &tmp_clone_id, sizeof(struct input_id));
-        return 0;
-}
+   -1 : Syscall failed and errno is set: no changes were made.
 
-static int read_monitor_keys(uint64_t *valuev)
+   >0 : One of the SETTINGS_ERROR_-prefixed values defined in settings.h.
+*/
+int settings_read(struct settings *settings)
 {
-        char *key_line = NULL;
-        size_t key_line_size;
-        int retval = -1;
+        int retval;
+        struct settings tmp_settings;
 
-        if (readln(&key_line, &key_line_size,
-                   PATH_MONITOR_CAPABILITIES_KEY) == -1)
-                return -1;
+        memset(&tmp_settings, 0, sizeof(struct settings));
 
-        switch (strtovaluev(valuev, KEY_VALUEC, key_line)) {
+        switch ((retval = read_snapshot(&tmp_settings))) {
         case 0:
-                break;
-        case -1:
-                goto out;
-        case -2:
-                retval = SETTINGS_ERROR_DIRTY_MONITOR_KEY;
-                goto out;
-        case -3:
-                retval = SETTINGS_ERROR_DIRTY_MONITOR_KEY;
-                goto out;
+                tmp_settings.source = SETTINGS_SOURCE_SNAPSHOT;
+                memcpy(settings, &tmp_settings, sizeof(struct settings));
+                return 0;
+        case 1:
+                settings_free(&tmp_settings);
+                return settings_read_source(settings);
         default:
-                retval = SETTINGS_ERROR_UNKNOWN;
-                goto out;
+                settings_free(&tmp_settings);
+                return retval;
         }
-        retval = 0;
-out:
-        free(key_line);
-        return retval;
 }
 
-static int read_monitor_rels(uint64_t *valuev)
+/* Replaces the file at path with size bytes of data. The data is first
+   written into a temporary file which is then renamed over path, so
+   that readers never see a partial file. Returns -1 and sets errno on
+   failure. */
+static int replace_file(const char *path, const void *data, size_t size)
 {
-        char *rel_line = NULL;
-        size_t rel_line_size;
+        char *tmp_path;
+        const char tmp_tail[] = ".tmp";
+        ssize_t written;
         int retval = -1;
+        int orig_errno;
+        int fd;
 
-        if (readln(&rel_line, &rel_line_size,
-                   PATH_MONITOR_CAPABILITIES_REL) == -1)
+        tmp_path = (char *) calloc(strlen(path) + sizeof(tmp_tail),
+                                   sizeof(char));
+        if (tmp_path == NULL)
                 return -1;
+        strcat(strcpy(tmp_path, path), tmp_tail);
 
-        switch (strtovaluev(valuev, REL_VALUEC, rel_line)) {
-        case 0:
-                break;
-        case -1:
+        if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
                 goto out;
-        case -2:
-                retval = SETTINGS_ERROR_DIRTY_MONITOR_REL;
-                goto out;
-        case -3:
-                retval = SETTINGS_ERROR_DIRTY_MONITOR_REL;
+
+        if ((written = write(fd, data, size)) != size) {
+                if (written != -1)
+                        errno = EIO;
+                orig_errno = errno;
+                close(fd);
+                unlink(tmp_path);
+                errno = orig_errno;
                 goto out;
-        default:
-                retval = SETTINGS_ERROR_UNKNOWN;
+        }
+
+        if (close(fd) == -1 || rename(tmp_path, path) == -1) {
+                orig_errno = errno;
+                unlink(tmp_path);
+                errno = orig_errno;
                 goto out;
         }
+
         retval = 0;
 out:
-        free(rel_line);
+        orig_errno = errno;
+        free(tmp_path);
+        tmp_path = NULL;
+        errno = orig_errno;
         return retval;
 }
 
-static int read_filter_keys(uint64_t *valuev)
+/* Records which setting files of the pipelines of snapshot exist in the
+   configuration directory, for is_snapshot_stale(). */
+static void record_present(struct snapshot *snapshot)
+{
+        char path[_POSIX_PATH_MAX + 1];
+        unsigned int pipeline_i;
+        size_t i;
+
+        for (pipeline_i = 0; pipeline_i < snapshot->settings.pipelinec;
+             ++pipeline_i) {
+                for (i = 0; i < ENTRY_COUNT; ++i) {
+                        if (pipeline_i && !ENTRIES[i].is_pipeline)
+                                continue;
+                        snapshot->is_presentv[pipeline_i][i] =
+                                format_entry_path(path, &ENTRIES[i],
+                                                  pipeline_i) == 0
+                                && access(path, F_OK) == 0;
+                }
+        }
+}
+
+/* Writes settings into a snapshot at path which settings_read() can
+   load with a single mmap. A running daemon never sees a partial
+   snapshot.
+
+   Returns like settings_read(). */
+int settings_write_snapshot(const struct settings *settings,
+                            const char *path)
+{
+        struct snapshot snapshot;
+        unsigned int pipeline_i;
+
+        if (strlen(settings->monitor_name) >= SNAPSHOT_NAME_SIZE)
+                return SETTINGS_ERROR_SNAPSHOT_NAME;
+        for (pipeline_i = 0; pipeline_i < settings->pipelinec; ++pipeline_i) {
+                if (strlen(settings->pipelinev[pipeline_i].filter_name)
+                    >= SNAPSHOT_NAME_SIZE)
+                        return SETTINGS_ERROR_SNAPSHOT_NAME;
+        }
+
+        /* Padding is zeroed too, it is covered by the checksum. */
+        memset(&snapshot, 0, sizeof(struct snapshot));
+        memcpy(snapshot.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        snapshot.version = SNAPSHOT_VERSION;
+        snapshot.size = sizeof(struct snapshot);
+        strcpy(snapshot.monitor_name, settings->monitor_name);
+        memcpy(&snapshot.settings, settings, sizeof(struct settings));
+        snapshot.source = settings->source;
+        if (settings->source == SETTINGS_SOURCE_DIR)
+                record_present(&snapshot);
+        snapshot.settings.monitor_name = NULL;
+        for (pipeline_i = 0; pipeline_i < settings->pipelinec; ++pipeline_i) {
+                strcpy(snapshot.filter_namev[pipeline_i],
+                       settings->pipelinev[pipeline_i].filter_name);
+                snapshot.settings.pipelinev[pipeline_i].filter_name = NULL;
+        }
+        snapshot.settings.source = 0;
+        snapshot.checksum = checksum(SNAPSHOT_BODY(&snapshot),
+                                     SNAPSHOT_BODY_SIZE);
+
+        return replace_file(path, &snapshot, sizeof(struct snapshot));
+}
+
+/* Looks up the entry of name, which may be prefixed by `pipelines/<n>/'.
+   Returns the entry and stores its pipeline index to pipeline_ip, or
+   returns NULL if there is no such setting. */
+static const struct entry *find_entry(const char *name,
+                                      unsigned int *pipeline_ip)
+{
+        char *entry_name = (char *) name;
+        size_t i;
+        int split_i;
+
+        if ((split_i = split_pipeline(&entry_name)) == -1)
+                return NULL;
+
+        for (i = 0; i < ENTRY_COUNT; ++i) {
+                if (strcmp(entry_name, ENTRIES[i].name) == 0)
+                        break;
+        }
+        if (i == ENTRY_COUNT || (split_i && !ENTRIES[i].is_pipeline))
+                return NULL;
+
+        *pipeline_ip = split_i;
+        return &ENTRIES[i];
+}
+
+/* Finds the line of name in buf holding the contents of the
+   configuration file. Returns a pointer to the start of the line and
+   stores the start of its value to valuep and the end of the line to
+   endp, or returns NULL if name is not set. */
+static char *find_file_line(char *buf, const char *name, char **valuep,
+                            char **endp)
+{
+        char *line;
+        char *next;
+
+        for (line = buf; *line != '\0'; line = next) {
+                char *key = line;
+                char *key_end;
+                char *value;
+
+                if ((next = strchr(line, '\n')) == NULL)
+                        next = line + strlen(line);
+                else
+                        ++next;
+
+                while (key < next && isspace((unsigned char) *key))
+                        ++key;
+                if ((value = memchr(key, '=', next - key)) == NULL)
+                        continue;
+                for (key_end = value; key_end > key
+                             && isspace((unsigned char) key_end[-1]);
+                     --key_end);
+                if (key_end - key != strlen(name)
+                    || strncmp(key, name, key_end - key))
+                        continue;
+
+                *valuep = value + 1;
+                *endp = next;
+                return line;
+        }
+        return NULL;
+}
+
+/* Copies the value of name as written in the configuration file, or in
+   the configuration directory if there is no configuration file, into
+   buf of size bytes. An optional setting which is not set reads as an
+   empty string.
+
+   Returns
+
+   0 : The value was copied.
+
+   -1 : Syscall failed and errno is set.
+
+   >0 : SETTINGS_ERROR_UNKNOWN_ENTRY if there is no such setting.
+*/
+int settings_read_entry(const char *name, char *buf, size_t size)
 {
-        char *key_line = NULL;
-        size_t key_line_size;
+        const struct entry *entry;
+        unsigned int pipeline_i;
+        char path[_POSIX_PATH_MAX + 1];
+        char *line = NULL;
+        size_t line_size = 0;
+        char *value = "";
+        char *end;
+        char *file_buf = NULL;
         int retval = -1;
+        int orig_errno;
 
-        if (readln(&key_line, &key_line_size,
-                   PATH_FILTER_CAPABILITIES_KEY) == -1)
-                return -1;
+        if ((entry = find_entry(name, &pipeline_i)) == NULL)
+                return SETTINGS_ERROR_UNKNOWN_ENTRY;
 
-        switch (strtovaluev(valuev, KEY_VALUEC, key_line)) {
-        case 0:
-                break;
-        case -1:
-                goto out;
-        case -2:
-                retval = SETTINGS_ERROR_DIRTY_FILTER_KEY;
-                goto out;
-        case -3:
-                retval = SETTINGS_ERROR_DIRTY_FILTER_KEY;
-                goto out;
-        default:
-                retval = SETTINGS_ERROR_UNKNOWN;
+        if (access(PATH_CONFIG_FILE, F_OK) == 0) {
+                if ((file_buf = read_file(PATH_CONFIG_FILE)) == NULL)
+                        goto out;
+                if (find_file_line(file_buf, name, &value, &end) != NULL) {
+                        *end = '\0';
+                        value = strip(value);
+                }
+        } else {
+                if (format_entry_path(path, entry, pipeline_i) == -1)
+                        goto out;
+                if (readln(&line, &line_size, path) == 0)
+                        value = line;
+                else if (errno != ENOENT || !entry->is_optional)
+                        goto out;
+        }
+
+        if (strlen(value) >= size) {
+                errno = ERANGE;
                 goto out;
         }
+        strcpy(buf, value);
         retval = 0;
 out:
-        free(key_line);
+        orig_errno = errno;
+        free(line);
+        line = NULL;
+        free(file_buf);
+        file_buf = NULL;
+        errno = orig_errno;
         return retval;
 }
 
-static int read_filter_rels(uint64_t *valuev)
+/* Replaces the line of name in the configuration file with name =
+   value, or appends it if name is not set yet. */
+static int write_file_entry(const char *name, const char *value)
 {
-        char *rel_line = NULL;
-        size_t rel_line_size;
+        char *buf;
+        char *new_buf;
+        char *line;
+        char *value_start;
+        char *end;
+        size_t new_size;
         int retval = -1;
+        int orig_errno;
 
-        if (readln(&rel_line, &rel_line_size,
-                   PATH_FILTER_CAPABILITIES_REL) == -1)
+        if ((buf = read_file(PATH_CONFIG_FILE)) == NULL)
                 return -1;
 
-        switch (strtovaluev(valuev, REL_VALUEC, rel_line)) {
-        case 0:
-                break;
-        case -1:
-                goto out;
-        case -2:
-                retval = SETTINGS_ERROR_DIRTY_FILTER_REL;
-                goto out;
-        case -3:
-                retval = SETTINGS_ERROR_DIRTY_FILTER_REL;
-                goto out;
-        default:
-                retval = SETTINGS_ERROR_UNKNOWN;
+        if ((line = find_file_line(buf, name, &value_start, &end)) == NULL)
+                line = end = buf + strlen(buf);
+
+        /* The previous line might lack its newline. */
+        new_size = strlen(buf) + strlen(name) + strlen(value) + 6;
+        if ((new_buf = (char *) malloc(new_size)) == NULL)
                 goto out;
-        }
-        retval = 0;
+        new_size = snprintf(new_buf, new_size, "%.*s%s%s = %s\n%s",
+                            (int) (line - buf), buf,
+                            line > buf && line[-1] != '\n' ? "\n" : "",
+                            name, value, end);
+        retval = replace_file(PATH_CONFIG_FILE, new_buf, new_size);
 out:
-        free(rel_line);
+        orig_errno = errno;
+        free(new_buf);
+        new_buf = NULL;
+        free(buf);
+        buf = NULL;
+        errno = orig_errno;
         return retval;
 }
 
-int settings_read(struct settings *settings)
+/* Validates value for name and writes it into the configuration file,
+   or into the configuration directory if there is no configuration
+   file. The change is undone if the settings as a whole could not be
+   read after it. Running daemons do not see the change before they
+   re-read their settings.
+
+   Returns
+
+   0 : The value was written.
+
+   -1 : Syscall failed and errno is set: no changes were made.
+
+   >0 : One of the SETTINGS_ERROR_-prefixed values defined in
+   settings.h: no changes were made.
+*/
+int settings_write_entry(const char *name, const char *value)
 {
-        int retval;
+        const struct entry *entry;
         struct settings tmp_settings;
+        unsigned int pipeline_i;
+        char path[_POSIX_PATH_MAX + 1];
+        const char *write_path;
+        char *old_buf = NULL;
+        size_t old_size = 0;
+        char *line = NULL;
+        int retval;
+        int orig_errno;
+
+        if ((entry = find_entry(name, &pipeline_i)) == NULL)
+                return SETTINGS_ERROR_UNKNOWN_ENTRY;
+        if (strchr(value, '\n') != NULL)
+                return entry->errretval;
 
         memset(&tmp_settings, 0, sizeof(struct settings));
+        retval = entry->parse(entry, entry_base(entry, &tmp_settings,
+                                                pipeline_i), value);
+        settings_free(&tmp_settings);
+        if (retval != 0)
+                return retval;
 
-        if ((retval = read_filter_duration(&tmp_settings)) != 0)
-                goto err;
-        if ((retval = read_filter_name(&tmp_settings)) != 0)
-                goto err;
-        if ((retval = read_monitor_name(&tmp_settings)) != 0)
-                goto err;
-        if ((retval = read_clone_name(&tmp_settings)) != 0)
-                goto err;
-        if ((retval = read_clone_id(&tmp_settings.clone_id)) != 0)
-                goto err;
-        if ((retval = read_monitor_keys(tmp_settings.monitor_key_valuev)) != 0)
-                goto err;
-        if ((retval = read_monitor_rels(tmp_settings.monitor_rel_valuev)) != 0)
-                goto err;
-        if ((retval = read_filter_keys(tmp_settings.filter_key_valuev)) != 0)
-                goto err;
-        if ((retval = read_filter_rels(tmp_settings.filter_rel_valuev)) != 0)
-                goto err;
+        if (access(PATH_CONFIG_FILE, F_OK) == 0) {
+                write_path = PATH_CONFIG_FILE;
+                if ((old_buf = read_file(write_path)) == NULL)
+                        return -1;
+                if ((retval = write_file_entry(name, value)) != 0)
+                        goto out;
+        } else {
+                if (format_entry_path(path, entry, pipeline_i) == -1)
+                        return -1;
+                write_path = path;
+                if ((old_buf = read_file(write_path)) == NULL
+                    && errno != ENOENT)
+                        return -1;
+                if ((line = (char *) malloc(strlen(value) + 2)) == NULL) {
+                        retval = -1;
+                        goto out;
+                }
+                strcat(strcpy(line, value), "\n");
+                if ((retval = replace_file(write_path, line,
+                                           strlen(line))) != 0)
+                        goto out;
+        }
+        if (old_buf != NULL)
+                old_size = strlen(old_buf);
 
-        /* Safe to copy fresh settings because no error was detected.*/
-        memcpy(settings, &tmp_settings, sizeof(struct settings));
-        return 0;
-err:
-        settings_free(&tmp_settings);
+        if ((retval = settings_read_source(&tmp_settings)) == 0) {
+                settings_free(&tmp_settings);
+                goto out;
+        }
+
+        orig_errno = errno;
+        if (old_buf != NULL)
+                replace_file(write_path, old_buf, old_size);
+        else
+                unlink(write_path);
+        errno = orig_errno;
+out:
+        orig_errno = errno;
+        free(line);
+        line = NULL;
+        free(old_buf);
+        old_buf = NULL;
+        errno = orig_errno;
+        return retval;
+}
+
+/* Copies the suppression decisions of settings into preset, leaving
+   its name empty. */
+void settings_compile_preset(const struct settings *settings,
+                             struct preset *preset)
+{
+        unsigned int pipeline_i;
+
+        memset(preset, 0, sizeof(struct preset));
+        memcpy(preset->monitor_key_valuev, settings->monitor_key_valuev,
+               sizeof(preset->monitor_key_valuev));
+        memcpy(preset->monitor_rel_valuev, settings->monitor_rel_valuev,
+               sizeof(preset->monitor_rel_valuev));
+        for (pipeline_i = 0; pipeline_i < settings->pipelinec; ++pipeline_i) {
+                const struct pipeline_settings *from =
+                        &settings->pipelinev[pipeline_i];
+                struct preset_pipeline *to = &preset->pipelinev[pipeline_i];
+
+                memcpy(to->filter_key_valuev, from->filter_key_valuev,
+                       sizeof(to->filter_key_valuev));
+                memcpy(to->filter_rel_valuev, from->filter_rel_valuev,
+                       sizeof(to->filter_rel_valuev));
+                to->filter_duration = from->filter_duration;
+        }
+}
+
+static int is_preset_entry(const struct entry *entry)
+{
+        return strcmp(entry->name, "monitor/capabilities/key") == 0
+                || strcmp(entry->name, "monitor/capabilities/rel") == 0
+                || strcmp(entry->name, "filter/capabilities/key") == 0
+                || strcmp(entry->name, "filter/capabilities/rel") == 0
+                || strcmp(entry->name, "filter/duration") == 0;
+}
+
+/* Compiles the preset file at path into preset, leaving its name empty.
+   The file has the syntax of the configuration file, but sets only
+   suppression settings: monitor/capabilities/, filter/capabilities/
+   and filter/duration, of the pipelines of settings. Settings it does
+   not set keep their values in settings.
+
+   Returns
+
+   0 : Success.
+
+   -1 : Syscall failed and errno is set.
+
+   >0 : One of the SETTINGS_ERROR_-prefixed values defined in settings.h.
+*/
+int settings_read_preset(const struct settings *settings, const char *path,
+                         struct preset *preset)
+{
+        struct settings *compiled;
+        char *buf;
+        char *line;
+        char *next;
+        int retval = 0;
+
+        if ((buf = read_file(path)) == NULL)
+                return -1;
+
+        /* Only value arrays and numbers are parsed into the copy, it
+           shares no allocation with settings. */
+        if ((compiled = (struct settings *) malloc(
+                     sizeof(struct settings))) == NULL) {
+                free(buf);
+                return -1;
+        }
+        memcpy(compiled, settings, sizeof(struct settings));
+
+        for (line = buf; line != NULL && retval == 0; line = next) {
+                const struct entry *entry;
+                unsigned int pipeline_i;
+                char *name;
+                char *value;
+
+                if ((next = strchr(line, '\n')) != NULL)
+                        *next++ = '\0';
+
+                name = strip(line);
+                if (*name == '\0' || *name == '#')
+                        continue;
+
+                if ((value = strchr(name, '=')) == NULL) {
+                        retval = SETTINGS_ERROR_CONFIG_SYNTAX;
+                        break;
+                }
+                *value++ = '\0';
+                name = strip(name);
+                value = strip(value);
+
+                if ((entry = find_entry(name, &pipeline_i)) == NULL
+                    || !is_preset_entry(entry)
+                    || pipeline_i >= settings->pipelinec) {
+                        retval = SETTINGS_ERROR_PRESET_ENTRY;
+                        break;
+                }
+                retval = entry->parse(entry, entry_base(entry, compiled,
+                                                        pipeline_i),
+                                      value);
+        }
+
+        if (retval == 0)
+                settings_compile_preset(compiled, preset);
+        free(compiled);
+        compiled = NULL;
+        free(buf);
+        buf = NULL;
         return retval;
 }
 
 const char *settings_strerror(int settings_error)
 {
         if (settings_error < SETTINGS_ERROR_NO_ERROR
-            && settings_error >= SETTINGS_ERROR_COUNT)
+            || settings_error >= SETTINGS_ERROR_COUNT)
                 settings_error = SETTINGS_ERROR_UNKNOWN;
         return SETTINGS_ERROR_STRS[settings_error];
 }
 
 void settings_free(struct settings *settings)
 {
-        free(settings->filter_name);
+        unsigned int pipeline_i;
+
+        for (pipeline_i = 0; pipeline_i < PIPELINES_MAX; ++pipeline_i)
+                free(settings->pipelinev[pipeline_i].filter_name);
         free(settings->monitor_name);
         memset(settings, 0, sizeof(struct settings));
 }
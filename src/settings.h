@@ -20,6 +20,8 @@
 #include <linux/uinput.h>
 #include <stdint.h>
 
+#include "remap.h"
+
 #define SETTINGS_ERROR_NO_ERROR          0
 #define SETTINGS_ERROR_UNKNOWN           1
 #define SETTINGS_ERROR_FILTER_DURATION   2
@@ -31,28 +33,113 @@
 #define SETTINGS_ERROR_DIRTY_MONITOR_REL 8
 #define SETTINGS_ERROR_DIRTY_FILTER_KEY  9
 #define SETTINGS_ERROR_DIRTY_FILTER_REL  10
+#define SETTINGS_ERROR_COALESCE_RATE     11
+#define SETTINGS_ERROR_COALESCE_FRAMES   12
+#define SETTINGS_ERROR_CONFIG_SYNTAX     13
+#define SETTINGS_ERROR_CONFIG_MISSING    14
+#define SETTINGS_ERROR_SNAPSHOT_NAME     15
+#define SETTINGS_ERROR_TAP_FILTER        16
+#define SETTINGS_ERROR_TAP_MONITOR       17
+#define SETTINGS_ERROR_FILTER_REMAP      18
+#define SETTINGS_ERROR_MONITOR_MATCH_KEY 19
+#define SETTINGS_ERROR_MONITOR_MATCH_REL 20
+#define SETTINGS_ERROR_FILTER_REORDER    21
+#define SETTINGS_ERROR_UNKNOWN_ENTRY     22
+#define SETTINGS_ERROR_FILTER_PASSTHROUGH 23
+#define SETTINGS_ERROR_FILTER_DEBOUNCE   24
+#define SETTINGS_ERROR_MONITOR_HOLD_KEY  25
+#define SETTINGS_ERROR_MONITOR_HOLD_SW   26
+#define SETTINGS_ERROR_PRESET_ENTRY      27
+#define SETTINGS_ERROR_FILTER_STAGES     28
+
+#define SETTINGS_SOURCE_DIR      0
+#define SETTINGS_SOURCE_FILE     1
+#define SETTINGS_SOURCE_SNAPSHOT 2
 
 #define KEY_VALUEC (KEY_MAX / 64 + 1)
 #define REL_VALUEC (REL_MAX / 64 + 1)
+#define SW_VALUEC  (SW_MAX / 64 + 1)
 
-struct settings {
-        char *monitor_name;
-        size_t monitor_name_size;
+/* Pipelines beyond the first one are configured under
+   pipelines/1/ ... pipelines/<PIPELINES_MAX - 1>/. */
+#define PIPELINES_MAX 4
+
+/* Room for the line of filter stages, see stages.h. */
+#define FILTER_STAGES_SIZE 256
+
+/* Settings of one filter device and its clone. All pipelines are driven
+   by the same monitored events. */
+struct pipeline_settings {
         char *filter_name;
-        size_t filter_name_size;
         double filter_duration;
+        double filter_reorder;
+        double filter_debounce;
+        unsigned int filter_passthrough;
         char clone_name[UINPUT_MAX_NAME_SIZE];
         struct input_id clone_id;
+        uint64_t filter_key_valuev[KEY_VALUEC];
+        uint64_t filter_rel_valuev[REL_VALUEC];
+        double coalesce_rate;
+        unsigned int coalesce_frames;
+        struct remap filter_remap;
+        char filter_stages[FILTER_STAGES_SIZE];
+};
+
+struct settings {
+        int source;
+        char *monitor_name;
         uint64_t monitor_key_valuev[KEY_VALUEC];
         uint64_t monitor_rel_valuev[KEY_VALUEC];
+        uint64_t monitor_match_key_valuev[KEY_VALUEC];
+        uint64_t monitor_match_rel_valuev[REL_VALUEC];
+        uint64_t monitor_hold_key_valuev[KEY_VALUEC];
+        uint64_t monitor_hold_sw_valuev[SW_VALUEC];
+        unsigned int tap_filter;
+        unsigned int tap_monitor;
+        unsigned int pipelinec;
+        struct pipeline_settings pipelinev[PIPELINES_MAX];
+};
+
+/* Presets, including the base configuration named `default', are
+   compiled at startup and selected at runtime without reading any
+   file. */
+#define PRESETS_MAX      8
+#define PRESET_NAME_SIZE 32
+
+struct preset_pipeline {
         uint64_t filter_key_valuev[KEY_VALUEC];
         uint64_t filter_rel_valuev[REL_VALUEC];
+        double filter_duration;
+};
+
+/* Suppression decisions: which monitored events suppress which events
+   of every filter device, and for how long. */
+struct preset {
+        char name[PRESET_NAME_SIZE];
+        uint64_t monitor_key_valuev[KEY_VALUEC];
+        uint64_t monitor_rel_valuev[REL_VALUEC];
+        struct preset_pipeline pipelinev[PIPELINES_MAX];
 };
 
 const char *settings_strerror(int settings_error);
 
 int settings_read(struct settings *settings);
 
+int settings_read_source(struct settings *settings);
+
+int settings_write_snapshot(const struct settings *settings,
+                            const char *path);
+
+int settings_read_entry(const char *name, char *buf, size_t size);
+
+int settings_write_entry(const char *name, const char *value);
+
+void settings_compile_preset(const struct settings *settings,
+                             struct preset *preset);
+
+int settings_read_preset(const struct settings *settings, const char *path,
+                         struct preset *preset);
+
 void settings_free(struct settings *settings);
 
 #endif /* SETTINGS_H */
@@ -0,0 +1,226 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "config.h"
+#include "stages.h"
+
+/* A stage taking longer than this for a batch is warned about once. */
+#define STAGE_BUDGET 0.001
+
+void stages_init(struct stages *stages)
+{
+        memset(stages, 0, sizeof(struct stages));
+}
+
+/* Loads the stage at path, or under PATH_STAGES_DIR if path has no
+   slash, into stage and makes its state. Failures are logged. */
+static int open_stage(struct stage *stage, const char *path, const char *arg,
+                      unsigned int pipeline_i)
+{
+        char full_path[_POSIX_PATH_MAX + 1];
+        const struct evdaemon_stage *interface;
+
+        if (strchr(path, '/') == NULL) {
+                if (snprintf(full_path, sizeof(full_path), "%s/%s",
+                             PATH_STAGES_DIR, path) >= sizeof(full_path)) {
+                        syslog(LOG_ERR, "stage %s: %s", path,
+                               strerror(ENAMETOOLONG));
+                        return -1;
+                }
+                path = full_path;
+        }
+
+        memset(stage, 0, sizeof(struct stage));
+        if ((stage->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+                syslog(LOG_ERR, "stage %s", dlerror());
+                return -1;
+        }
+
+        interface = (const struct evdaemon_stage *)
+                dlsym(stage->handle, EVDAEMON_STAGE_SYMBOL);
+        if (interface == NULL) {
+                syslog(LOG_ERR, "stage %s: no %s", path,
+                       EVDAEMON_STAGE_SYMBOL);
+                goto err;
+        }
+        if (interface->abi_version != EVDAEMON_STAGE_ABI_VERSION) {
+                syslog(LOG_ERR, "stage %s: ABI version %u, expected %u",
+                       path, (unsigned) interface->abi_version,
+                       (unsigned) EVDAEMON_STAGE_ABI_VERSION);
+                goto err;
+        }
+        if (interface->name == NULL || interface->process == NULL) {
+                syslog(LOG_ERR, "stage %s: no name or process function",
+                       path);
+                goto err;
+        }
+        if (interface->init != NULL
+            && interface->init(&stage->state, pipeline_i, arg) == -1) {
+                syslog(LOG_ERR, "stage %s: init: %s", interface->name,
+                       strerror(errno));
+                goto err;
+        }
+        stage->stage = interface;
+        return 0;
+err:
+        dlclose(stage->handle);
+        stage->handle = NULL;
+        return -1;
+}
+
+/* Loads the stages listed in line, separated by whitespace, each one a
+   path optionally followed by `:' and an argument to the stage. On
+   failure, no stage is left loaded. */
+int stages_open(struct stages *stages, const char *line,
+                unsigned int pipeline_i)
+{
+        char *buf;
+        char *saveptr;
+        char *path;
+        char *arg;
+
+        stages_init(stages);
+        if ((buf = strdup(line)) == NULL) {
+                syslog(LOG_ERR, "stages: %s", strerror(errno));
+                return -1;
+        }
+
+        for (path = strtok_r(buf, " \t", &saveptr); path != NULL;
+             path = strtok_r(NULL, " \t", &saveptr)) {
+                if (stages->stagec == STAGES_MAX) {
+                        syslog(LOG_ERR, "stages: more than %d", STAGES_MAX);
+                        goto err;
+                }
+                if ((arg = strchr(path, ':')) != NULL)
+                        *arg++ = '\0';
+                if (open_stage(&stages->stagev[stages->stagec], path, arg,
+                               pipeline_i) == -1)
+                        goto err;
+                ++stages->stagec;
+        }
+
+        free(buf);
+        return 0;
+err:
+        free(buf);
+        stages_close(stages);
+        return -1;
+}
+
+/* Frees the states and unloads the stages, the last one first. */
+void stages_close(struct stages *stages)
+{
+        while (stages->stagec) {
+                struct stage *stage = &stages->stagev[--stages->stagec];
+
+                if (stage->stage->fini != NULL)
+                        stage->stage->fini(stage->state);
+                dlclose(stage->handle);
+        }
+        stages_init(stages);
+}
+
+static double elapsed(const struct timespec *start,
+                      const struct timespec *end)
+{
+        return (end->tv_sec - start->tv_sec)
+                + (end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+/* Calls a processing function of stage on batch and keeps track of the
+   time it takes. */
+static void call_stage(struct stage *stage,
+                       void (*func)(void *state,
+                                    struct evdaemon_stage_batch *batch),
+                       struct evdaemon_stage_batch *batch)
+{
+        struct timespec start;
+        struct timespec end;
+        double          seconds;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        func(stage->state, batch);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        ++stage->batchc;
+        if ((seconds = elapsed(&start, &end)) <= stage->max_seconds)
+                return;
+        stage->max_seconds = seconds;
+        if (seconds > STAGE_BUDGET && !stage->is_slow) {
+                stage->is_slow = 1;
+                syslog(LOG_WARNING, "stage %s: %.0f us for a batch of %u "
+                       "events", stage->stage->name, seconds * 1000000.0,
+                       (unsigned) batch->eventc);
+        }
+}
+
+/* Passes the eventc events in eventv, which has room for eventn events,
+   through the stages in order, calling back the stages whose deadlines
+   have passed by now on the way. Returns the number of events left in
+   eventv. */
+int stages_run(struct stages *stages, double now, struct input_event *eventv,
+               int eventc, int eventn)
+{
+        struct evdaemon_stage_batch batch;
+        int                         i;
+
+        batch.eventc = eventc;
+        for (i = 0; i < stages->stagec; ++i) {
+                struct stage *stage = &stages->stagev[i];
+
+                /* Only eventc and deadline are the stage's to change. */
+                batch.eventv = eventv;
+                batch.eventn = eventn;
+                batch.now = now;
+                batch.deadline = stage->deadline;
+                if (batch.eventc)
+                        call_stage(stage, stage->stage->process, &batch);
+                if (batch.deadline && batch.deadline <= now) {
+                        batch.deadline = 0;
+                        if (stage->stage->expire != NULL)
+                                call_stage(stage, stage->stage->expire,
+                                           &batch);
+                }
+                if (batch.eventc > eventn)
+                        batch.eventc = eventn;
+                stage->deadline = batch.deadline;
+        }
+        return batch.eventc;
+}
+
+/* Returns the nearest deadline of the stages or 0 if none is set. */
+double stages_deadline(const struct stages *stages)
+{
+        double deadline = 0;
+        int    i;
+
+        for (i = 0; i < stages->stagec; ++i) {
+                double stage_deadline = stages->stagev[i].deadline;
+
+                if (stage_deadline && (!deadline || stage_deadline < deadline))
+                        deadline = stage_deadline;
+        }
+        return deadline;
+}
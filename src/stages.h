@@ -0,0 +1,62 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <linux/input.h>
+
+#include "evdaemon-stage.h"
+
+/* The filter stages of a pipeline, see evdaemon-stage.h. Stages are
+   loaded and their state is made when the pipeline opens, the forward
+   path only calls them. */
+
+#define STAGES_MAX 4
+
+struct stage {
+        void                        *handle;
+        const struct evdaemon_stage *stage;
+        void                        *state;
+        double                       deadline;
+        unsigned long                batchc;
+        double                       max_seconds; /* Slowest batch. */
+        int                          is_slow;     /* Over budget once. */
+};
+
+struct stages {
+        struct stage stagev[STAGES_MAX];
+        int          stagec;
+};
+
+void stages_init(struct stages *stages);
+
+int stages_open(struct stages *stages, const char *line,
+                unsigned int pipeline_i);
+
+void stages_close(struct stages *stages);
+
+static inline int stages_is_enabled(const struct stages *stages)
+{
+        return stages->stagec;
+}
+
+int stages_run(struct stages *stages, double now, struct input_event *eventv,
+               int eventc, int eventn);
+
+double stages_deadline(const struct stages *stages);
+
+#endif /* STAGES_H */
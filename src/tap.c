@@ -0,0 +1,322 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE /* memfd_create, accept4 */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "tap.h"
+
+static struct evdaemon_tap_header *header = NULL;
+static struct evdaemon_tap_record *slotv = NULL;
+static size_t                      map_size = 0;
+/* Consumers could write the header through a writable mapping of their
+   own, so the ring geometry and position are never read back from it. */
+static uint32_t                    ring_slotc = 0;
+static uint64_t                    ring_head = 0;
+static uint64_t                    notified_head = 0;
+static int                         memfd = -1;
+/* The ring reopened read-only, passed to consumers. */
+static int                         ro_memfd = -1;
+static int                         listen_fd = -1;
+static char                        listen_path[sizeof(struct sockaddr_un)];
+static struct {
+        int sock_fd;
+        int event_fd;
+} clientv[TAP_CLIENTS_MAX];
+
+/* Creates the ring with room for slotc records and starts listening for
+   consumers at socket_path, which only the owner of evdaemon can
+   connect to: the tap carries every key typed.
+
+   Returns
+
+   0 : The tap is open.
+
+   -1 : Syscall failed and errno is set: all resources were released.
+*/
+int tap_open(const char *socket_path, unsigned slotc)
+{
+        struct sockaddr_un addr;
+        char               fd_path[32];
+        int                orig_errno;
+        int                i;
+
+        for (i = 0; i < TAP_CLIENTS_MAX; ++i) {
+                clientv[i].sock_fd = -1;
+                clientv[i].event_fd = -1;
+        }
+
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+
+        map_size = sizeof(struct evdaemon_tap_header)
+                + slotc * sizeof(struct evdaemon_tap_record);
+
+        if ((memfd = memfd_create("evdaemon-tap",
+                                  MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+                goto err;
+
+        if (ftruncate(memfd, map_size) == -1)
+                goto err;
+
+        /* Consumers must not be able to resize the ring under us. */
+        if (fcntl(memfd, F_ADD_SEALS,
+                  F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+                goto err;
+
+        header = (struct evdaemon_tap_header *) mmap(NULL, map_size,
+                                                     PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED, memfd, 0);
+        if (header == MAP_FAILED) {
+                header = NULL;
+                goto err;
+        }
+        slotv = (struct evdaemon_tap_record *) (header + 1);
+
+        memcpy(header->magic, EVDAEMON_TAP_MAGIC, sizeof(EVDAEMON_TAP_MAGIC));
+        header->version = EVDAEMON_TAP_VERSION;
+        header->slotc = slotc;
+        ring_slotc = slotc;
+        ring_head = 0;
+        notified_head = 0;
+
+        snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", memfd);
+        if ((ro_memfd = open(fd_path, O_RDONLY | O_CLOEXEC)) == -1)
+                goto err;
+
+        if ((listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC
+                                | SOCK_NONBLOCK, 0)) == -1)
+                goto err;
+
+        memset(&addr, 0, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        /* A stale socket of a previous instance. */
+        unlink(socket_path);
+
+        if (bind(listen_fd, (struct sockaddr *) &addr,
+                 sizeof(struct sockaddr_un)) == -1)
+                goto err;
+        strcpy(listen_path, socket_path);
+
+        if (chmod(socket_path, S_IRUSR | S_IWUSR) == -1)
+                goto err;
+
+        if (listen(listen_fd, TAP_CLIENTS_MAX) == -1)
+                goto err;
+
+        return 0;
+err:
+        orig_errno = errno;
+        tap_close();
+        errno = orig_errno;
+        return -1;
+}
+
+void tap_close(void)
+{
+        int i;
+
+        /* Clients exist only while listening. */
+        if (listen_fd != -1) {
+                for (i = 0; i < TAP_CLIENTS_MAX; ++i) {
+                        if (clientv[i].sock_fd != -1)
+                                close(clientv[i].sock_fd);
+                        if (clientv[i].event_fd != -1)
+                                close(clientv[i].event_fd);
+                        clientv[i].sock_fd = -1;
+                        clientv[i].event_fd = -1;
+                }
+                close(listen_fd);
+                unlink(listen_path);
+                listen_fd = -1;
+        }
+        if (header != NULL) {
+                munmap(header, map_size);
+                header = NULL;
+                slotv = NULL;
+        }
+        if (ro_memfd != -1) {
+                close(ro_memfd);
+                ro_memfd = -1;
+        }
+        if (memfd != -1) {
+                close(memfd);
+                memfd = -1;
+        }
+}
+
+int tap_is_open(void)
+{
+        return header != NULL;
+}
+
+/* Appends events to the ring. Costs a copy per event, consumers are
+   woken up later by tap_notify() once per wakeup of the event loop. */
+void tap_publish(uint32_t role, const struct input_event *eventv,
+                 int eventc)
+{
+        uint64_t head = ring_head;
+        int      i;
+
+        for (i = 0; i < eventc; ++i, ++head) {
+                struct evdaemon_tap_record *slot;
+
+                slot = &slotv[head % ring_slotc];
+                __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+                slot->role = role;
+                slot->event = eventv[i];
+                __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+        }
+        ring_head = head;
+        __atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+}
+
+/* Wakes up all consumers if records were published since the previous
+   call. eventfd writes never block, so a stalled consumer cannot stall
+   evdaemon. */
+void tap_notify(void)
+{
+        const uint64_t one = 1;
+        int            i;
+
+        if (ring_head == notified_head)
+                return;
+        notified_head = ring_head;
+
+        for (i = 0; i < TAP_CLIENTS_MAX; ++i) {
+                if (clientv[i].event_fd != -1
+                    && write(clientv[i].event_fd, &one, sizeof(one)) == -1) {
+                        /* Counter is saturated, the consumer is asleep
+                           or dead and its wakeup is pending anyway. */
+                }
+        }
+}
+
+int tap_listen_fd(void)
+{
+        return listen_fd;
+}
+
+int tap_client_fd(int client_i)
+{
+        return clientv[client_i].sock_fd;
+}
+
+/* Accepts a pending consumer and passes it the ring and an eventfd.
+
+   Returns
+
+   >=0 : Index of the new client.
+
+   -1 : Syscall failed or there is no room for more clients, errno is
+   set. The connection was closed.
+*/
+int tap_accept(void)
+{
+        struct msghdr   msg;
+        struct iovec    iov;
+        struct cmsghdr *cmsg;
+        char            cbuf[CMSG_SPACE(2 * sizeof(int))];
+        char            byte = 0;
+        int             fdv[2];
+        int             sock_fd;
+        int             event_fd = -1;
+        int             orig_errno;
+        int             i;
+
+        if ((sock_fd = accept4(listen_fd, NULL, NULL,
+                               SOCK_CLOEXEC | SOCK_NONBLOCK)) == -1)
+                return -1;
+
+        for (i = 0; i < TAP_CLIENTS_MAX; ++i) {
+                if (clientv[i].sock_fd == -1)
+                        break;
+        }
+        if (i == TAP_CLIENTS_MAX) {
+                errno = EMFILE;
+                goto err;
+        }
+
+        if ((event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+                goto err;
+
+        fdv[0] = ro_memfd;
+        fdv[1] = event_fd;
+
+        memset(&msg, 0, sizeof(struct msghdr));
+        memset(cbuf, 0, sizeof(cbuf));
+        iov.iov_base = &byte;
+        iov.iov_len = sizeof(byte);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fdv));
+        memcpy(CMSG_DATA(cmsg), fdv, sizeof(fdv));
+
+        if (sendmsg(sock_fd, &msg, MSG_NOSIGNAL) == -1)
+                goto err;
+
+        clientv[i].sock_fd = sock_fd;
+        clientv[i].event_fd = event_fd;
+        return i;
+err:
+        orig_errno = errno;
+        if (event_fd != -1)
+                close(event_fd);
+        close(sock_fd);
+        errno = orig_errno;
+        return -1;
+}
+
+/* Handles a readable client socket. Consumers are not expected to send
+   anything, so readability means the consumer went away.
+
+   Returns 1 if the client is still connected, 0 if it was dropped. */
+int tap_handle_client(int client_i)
+{
+        char    buf[16];
+        ssize_t bytes;
+
+        bytes = recv(clientv[client_i].sock_fd, buf, sizeof(buf),
+                     MSG_DONTWAIT);
+        if (bytes > 0 || (bytes == -1 && errno == EAGAIN))
+                return 1;
+
+        close(clientv[client_i].sock_fd);
+        close(clientv[client_i].event_fd);
+        clientv[client_i].sock_fd = -1;
+        clientv[client_i].event_fd = -1;
+        return 0;
+}
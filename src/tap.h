@@ -0,0 +1,46 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TAP_H
+#define TAP_H
+
+#include <linux/input.h>
+#include <stdint.h>
+
+#include "evdaemon-tap.h"
+
+#define TAP_CLIENTS_MAX 8
+
+int tap_open(const char *socket_path, unsigned slotc);
+
+void tap_close(void);
+
+int tap_is_open(void);
+
+void tap_publish(uint32_t role, const struct input_event *eventv,
+                 int eventc);
+
+void tap_notify(void);
+
+int tap_listen_fd(void);
+
+int tap_client_fd(int client_i);
+
+int tap_accept(void);
+
+int tap_handle_client(int client_i);
+
+#endif /* TAP_H */
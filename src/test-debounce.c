@@ -0,0 +1,102 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Checks the decisions of the debouncer on chattering key switches. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debounce.h"
+
+#define WINDOW 0.020
+
+static struct debounce debounce;
+static int             failc = 0;
+
+static void expect_event(double time, int value, int expected)
+{
+        struct input_event event;
+        int                retval;
+
+        memset(&event, 0, sizeof(struct input_event));
+        event.time.tv_sec = (time_t) time;
+        event.time.tv_usec = (suseconds_t) ((time - event.time.tv_sec)
+                                            * 1000000 + 0.5);
+        event.type = EV_KEY;
+        event.code = BTN_LEFT;
+        event.value = value;
+
+        if ((retval = debounce_event(&debounce, &event)) != expected) {
+                fprintf(stderr, "%.3f value %d: %d, expected %d\n", time,
+                        value, retval, expected);
+                ++failc;
+        }
+}
+
+static void expect_release(double now, int expected)
+{
+        struct input_event eventv[DEBOUNCE_HELD_MAX];
+        int                releasec;
+
+        releasec = debounce_release(&debounce, now, eventv);
+        if (releasec != expected
+            || (releasec && (eventv[0].code != BTN_LEFT
+                             || eventv[0].value != 0))) {
+                fprintf(stderr, "%.3f: %d releases, expected %d\n", now,
+                        releasec, expected);
+                ++failc;
+        }
+}
+
+int main(void)
+{
+        debounce_init(&debounce, WINDOW);
+
+        /* Press, bounce release, press: the key stays down, and the
+           release which follows much later passes. */
+        expect_event(1.000, 1, DEBOUNCE_PASS);
+        expect_event(1.005, 0, DEBOUNCE_HOLD);
+        expect_event(1.008, 1, DEBOUNCE_DROP);
+        expect_event(1.100, 2, DEBOUNCE_PASS);
+        expect_release(1.200, 0);
+        expect_event(1.500, 0, DEBOUNCE_PASS);
+
+        /* A quick tap is released once its window has passed. */
+        expect_event(2.000, 1, DEBOUNCE_PASS);
+        expect_event(2.010, 0, DEBOUNCE_HOLD);
+        if (debounce_deadline(&debounce) < 2.010 + WINDOW - 0.000001
+            || debounce_deadline(&debounce) > 2.010 + WINDOW + 0.000001) {
+                fprintf(stderr, "deadline %f\n",
+                        debounce_deadline(&debounce));
+                ++failc;
+        }
+        expect_release(2.020, 0);
+        expect_release(2.030, 1);
+        if (debounce_is_holding(&debounce)) {
+                fprintf(stderr, "release still held\n");
+                ++failc;
+        }
+
+        /* Press, release, bounce press, bounce release: the key stays
+           up. */
+        expect_event(3.000, 1, DEBOUNCE_PASS);
+        expect_event(3.500, 0, DEBOUNCE_PASS);
+        expect_event(3.505, 1, DEBOUNCE_DROP);
+        expect_event(3.507, 0, DEBOUNCE_DROP);
+        expect_event(3.600, 1, DEBOUNCE_PASS);
+
+        return failc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
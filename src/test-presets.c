@@ -0,0 +1,97 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Checks that a preset overrides whole masks of the base configuration,
+   loading the preset suppressing nothing of etc/evdaemon/presets/README
+   over the default masks. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "settings.h"
+
+static const char preset_text[] =
+        "filter/capabilities/key = 0\n"
+        "filter/capabilities/rel = 0\n";
+
+int main(void)
+{
+        char            path[] = "/tmp/evdaemon-test-presets.XXXXXX";
+        struct settings settings;
+        struct preset   preset;
+        int             exitval = EXIT_FAILURE;
+        int             retval;
+        int             fd;
+        int             i;
+
+        memset(&settings, 0, sizeof(struct settings));
+        settings.pipelinec = 1;
+        settings.pipelinev[0].filter_duration = 2.0;
+        /* BTN_LEFT, BTN_RIGHT and BTN_MIDDLE, as in `70000 0 0 0 0' of
+           filter/capabilities/key, and REL_X. */
+        settings.pipelinev[0].filter_key_valuev[BTN_LEFT / 64] =
+                (uint64_t) 7 << (BTN_LEFT % 64);
+        settings.pipelinev[0].filter_rel_valuev[0] = 0x1;
+        settings.monitor_key_valuev[0] = 0x2;
+
+        if ((fd = mkstemp(path)) == -1) {
+                perror("mkstemp");
+                return EXIT_FAILURE;
+        }
+        if (write(fd, preset_text, sizeof(preset_text) - 1)
+            != sizeof(preset_text) - 1) {
+                perror("write");
+                close(fd);
+                goto out;
+        }
+        close(fd);
+
+        if ((retval = settings_read_preset(&settings, path, &preset)) != 0) {
+                fprintf(stderr, "settings_read_preset: %s\n",
+                        retval == -1 ? "syscall failed"
+                        : settings_strerror(retval));
+                goto out;
+        }
+
+        for (i = 0; i < KEY_VALUEC; ++i) {
+                if (preset.pipelinev[0].filter_key_valuev[i]) {
+                        fprintf(stderr, "key word %d: %llx\n", i,
+                                (unsigned long long)
+                                preset.pipelinev[0].filter_key_valuev[i]);
+                        goto out;
+                }
+        }
+        for (i = 0; i < REL_VALUEC; ++i) {
+                if (preset.pipelinev[0].filter_rel_valuev[i]) {
+                        fprintf(stderr, "rel word %d: %llx\n", i,
+                                (unsigned long long)
+                                preset.pipelinev[0].filter_rel_valuev[i]);
+                        goto out;
+                }
+        }
+        /* What the preset does not set is kept. */
+        if (preset.pipelinev[0].filter_duration != 2.0
+            || preset.monitor_key_valuev[0] != 0x2) {
+                fprintf(stderr, "unset settings changed\n");
+                goto out;
+        }
+
+        exitval = EXIT_SUCCESS;
+out:
+        unlink(path);
+        return exitval;
+}
@@ -0,0 +1,743 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Soak and fault injection test of a built evdaemon, run by `make soak'
+   and not by `make check': it needs root, creates input devices and
+   runs for as long as it is told to.
+
+   Stand-in filter and monitor devices are created with uinput and a
+   configuration using them is written into PATH_CONFIG_FILE. Then
+
+   1. evdaemon is started and stopped with SIGTERM at increasing delays,
+      so that the signal lands in every step of the startup, cloning the
+      filter device included. It has to exit without crashing and leave
+      no clone behind.
+
+   2. evdaemon is run for the given time while mouse motion and clicks
+      are written to the filter device and key strokes to the monitor
+      device, at a realistic and at a peak rate in turns. Faults are
+      injected in turns: the monitor device is removed in the middle of
+      a frame and created again, evdaemon is stopped while both devices
+      are flooded so that the kernel drops events (SYN_DROPPED), and the
+      configuration is rewritten with the `set' control request.
+      Resource use is polled with the `stats' control request every
+      second, the test fails if resident memory, open file descriptors,
+      mean latency or CPU time per event grow beyond their thresholds
+      over the baseline sampled after a warm-up.
+
+   3. The filter device is removed in the middle of a frame. evdaemon
+      has to exit without crashing and leave no clone behind. */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "config.h"
+#include "control.h"
+#include "util.h"
+
+#define FILTER_NAME  "evdaemon soak filter"
+#define MONITOR_NAME "evdaemon soak monitor"
+#define CLONE_NAME   "evdaemon soak clone"
+
+/* SIGTERM is sent STARTUP_KILLC times during startup, after 0, 1, ...
+   STARTUP_KILLC - 1 milliseconds. */
+#define STARTUP_KILLC      32
+#define EXIT_TIMEOUT       5.0
+#define READY_TIMEOUT      10.0
+/* Frames written to each device while evdaemon is stopped, a multiple
+   of the evdev client buffer, and the number of such floods. */
+#define FLOOD_FRAMEC       4096
+#define FLOOD_STOPC        8
+#define MONITOR_GONE_TIME  0.2
+#define FAULT_INTERVAL     20.0
+#define RATE_INTERVAL      60.0
+#define KEY_INTERVAL       0.1
+#define CLICK_INTERVAL     0.5
+
+static const char config_text[] =
+        "filter/name = " FILTER_NAME "\n"
+        "filter/duration = 0.5\n"
+        /* BTN_LEFT, BTN_RIGHT and BTN_MIDDLE. */
+        "filter/capabilities/key = 70000 0 0 0 0\n"
+        "filter/capabilities/rel = 0\n"
+        "monitor/name = " MONITOR_NAME "\n"
+        /* Every key of the monitor stand-in, KEY_ESC to KEY_CAPSLOCK. */
+        "monitor/capabilities/key = 7fffffffffffffe\n"
+        "monitor/capabilities/rel = 0\n"
+        "clone/name = " CLONE_NAME "\n"
+        "clone/id/bustype = 6\n"
+        "clone/id/vendor = 0\n"
+        "clone/id/product = 0\n"
+        "clone/id/version = 0\n";
+
+/* Statistics of the `stats' control request checked by the test. */
+struct sample {
+        double resident_kb;
+        double fds;
+        double cpu_us_per_event;
+        double latency_us_mean;
+};
+
+static const char *evdaemon_path;
+static double      duration = 600.0;
+static double      realistic_rate = 125.0;
+static double      peak_rate = 1000.0;
+static double      max_resident_growth_kb = 1024.0;
+static double      max_fds_growth = 0.0;
+static double      max_slowdown = 2.0;
+
+static pid_t evdaemon_pid = -1;
+static int   filter_fd = -1;
+static int   monitor_fd = -1;
+static int   control_fd = -1;
+static int   is_config_written = 0;
+
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void sleep_for(double seconds)
+{
+        struct timespec ts;
+
+        if (seconds <= 0.0)
+                return;
+        ts.tv_sec = (time_t) seconds;
+        ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1000000000.0);
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+                ;
+}
+
+/* Creates a stand-in device named name with uinput: a three button
+   mouse if is_filter, otherwise a keyboard. Returns -1 and sets errno
+   on failure. */
+static int create_standin(const char *name, int is_filter)
+{
+        struct uinput_user_dev user_dev;
+        const char *uinput_devnode;
+        int orig_errno;
+        int code;
+        int fd;
+
+        /* get_uinput_devnode() does not set errno when there is no
+           uinput device. */
+        errno = ENODEV;
+        if ((uinput_devnode = get_uinput_devnode()) == NULL)
+                return -1;
+
+        if ((fd = open(uinput_devnode, O_RDWR)) == -1)
+                return -1;
+
+        if (ioctl(fd, UI_SET_EVBIT, EV_KEY) == -1)
+                goto err;
+        if (is_filter) {
+                if (ioctl(fd, UI_SET_EVBIT, EV_REL) == -1
+                    || ioctl(fd, UI_SET_RELBIT, REL_X) == -1
+                    || ioctl(fd, UI_SET_RELBIT, REL_Y) == -1
+                    || ioctl(fd, UI_SET_KEYBIT, BTN_LEFT) == -1
+                    || ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT) == -1
+                    || ioctl(fd, UI_SET_KEYBIT, BTN_MIDDLE) == -1)
+                        goto err;
+        } else {
+                for (code = KEY_ESC; code <= KEY_CAPSLOCK; ++code) {
+                        if (ioctl(fd, UI_SET_KEYBIT, code) == -1)
+                                goto err;
+                }
+        }
+
+        memset(&user_dev, 0, sizeof(struct uinput_user_dev));
+        strncpy(user_dev.name, name, UINPUT_MAX_NAME_SIZE - 1);
+        user_dev.id.bustype = BUS_VIRTUAL;
+
+        if (write(fd, &user_dev, sizeof(struct uinput_user_dev))
+            != sizeof(struct uinput_user_dev))
+                goto err;
+
+        if (ioctl(fd, UI_DEV_CREATE) == -1)
+                goto err;
+
+        /* Give udev time to create the device node. */
+        sleep_for(0.2);
+        return fd;
+err:
+        orig_errno = errno;
+        close(fd);
+        errno = orig_errno;
+        return -1;
+}
+
+static void destroy_standin(int *fd)
+{
+        if (*fd == -1)
+                return;
+        ioctl(*fd, UI_DEV_DESTROY);
+        close(*fd);
+        *fd = -1;
+}
+
+static int emit(int fd, int type, int code, int value)
+{
+        struct input_event event;
+
+        memset(&event, 0, sizeof(struct input_event));
+        event.type = type;
+        event.code = code;
+        event.value = value;
+        if (write(fd, &event, sizeof(struct input_event))
+            != sizeof(struct input_event)) {
+                perror("write stand-in event");
+                return -1;
+        }
+        return 0;
+}
+
+/* Writes one frame of mouse motion, with a click or release of
+   BTN_LEFT if is_click is set. */
+static int emit_motion(int frame_i, int is_click)
+{
+        int step = frame_i % 2 ? 1 : -1;
+
+        if (emit(filter_fd, EV_REL, REL_X, step) == -1
+            || emit(filter_fd, EV_REL, REL_Y, -step) == -1)
+                return -1;
+        if (is_click
+            && emit(filter_fd, EV_KEY, BTN_LEFT, frame_i % 2) == -1)
+                return -1;
+        return emit(filter_fd, EV_SYN, SYN_REPORT, 0);
+}
+
+static int emit_key(int value)
+{
+        if (emit(monitor_fd, EV_KEY, KEY_A, value) == -1)
+                return -1;
+        return emit(monitor_fd, EV_SYN, SYN_REPORT, 0);
+}
+
+/* Writes the configuration of the stand-in devices. An existing
+   configuration file is not overwritten. */
+static int write_config(void)
+{
+        int fd;
+
+        fd = open(PATH_CONFIG_FILE, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd == -1) {
+                fprintf(stderr, "create %s: %s%s\n", PATH_CONFIG_FILE,
+                        strerror(errno), errno == EEXIST
+                        ? ", move it aside for the soak test" : "");
+                return -1;
+        }
+        is_config_written = 1;
+        if (write(fd, config_text, sizeof(config_text) - 1)
+            != sizeof(config_text) - 1) {
+                perror("write configuration");
+                close(fd);
+                return -1;
+        }
+        return close(fd);
+}
+
+static int start_evdaemon(void)
+{
+        int fd;
+
+        if ((evdaemon_pid = fork()) == -1) {
+                perror("fork");
+                return -1;
+        }
+        if (evdaemon_pid == 0) {
+                /* Everything evdaemon has to say is in syslog too. */
+                if ((fd = open("/dev/null", O_WRONLY)) != -1) {
+                        dup2(fd, STDOUT_FILENO);
+                        dup2(fd, STDERR_FILENO);
+                        close(fd);
+                }
+                execl(evdaemon_path, evdaemon_path, (char *) NULL);
+                _exit(127);
+        }
+        return 0;
+}
+
+/* Waits at most timeout seconds for evdaemon to exit. Returns 0 if it
+   exited without crashing: by exiting or by SIGTERM if is_sigterm_ok.
+   A leftover clone device counts as a failure too. */
+static int wait_exit(double timeout, int is_sigterm_ok)
+{
+        double deadline = now() + timeout;
+        int status;
+        pid_t pid;
+        int fd;
+
+        while ((pid = waitpid(evdaemon_pid, &status, WNOHANG)) == 0
+               && now() < deadline)
+                sleep_for(0.01);
+        if (pid == 0) {
+                fprintf(stderr, "evdaemon did not exit in %.0f s\n",
+                        timeout);
+                kill(evdaemon_pid, SIGKILL);
+                waitpid(evdaemon_pid, &status, 0);
+                evdaemon_pid = -1;
+                return -1;
+        }
+        evdaemon_pid = -1;
+        if (pid == -1) {
+                perror("waitpid");
+                return -1;
+        }
+
+        if (WIFSIGNALED(status)
+            && !(is_sigterm_ok && WTERMSIG(status) == SIGTERM)) {
+                fprintf(stderr, "evdaemon killed by signal %d\n",
+                        WTERMSIG(status));
+                return -1;
+        }
+        if ((fd = open_evdev_by_name(CLONE_NAME, O_RDONLY)) != -1) {
+                fprintf(stderr, "clone device left behind\n");
+                close(fd);
+                return -1;
+        }
+        return 0;
+}
+
+static int stop_evdaemon(void)
+{
+        if (kill(evdaemon_pid, SIGTERM) == -1) {
+                perror("kill evdaemon");
+                return -1;
+        }
+        return wait_exit(EXIT_TIMEOUT, 1);
+}
+
+/* Connects to the control socket once evdaemon has opened it. */
+static int connect_control(void)
+{
+        struct sockaddr_un addr;
+        double deadline = now() + READY_TIMEOUT;
+        int status;
+
+        memset(&addr, 0, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, PATH_CONTROL_SOCKET,
+                sizeof(addr.sun_path) - 1);
+
+        while (now() < deadline) {
+                if (waitpid(evdaemon_pid, &status, WNOHANG) != 0) {
+                        fprintf(stderr, "evdaemon exited during startup, "
+                                "see syslog\n");
+                        evdaemon_pid = -1;
+                        return -1;
+                }
+                control_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+                if (control_fd == -1) {
+                        perror("socket");
+                        return -1;
+                }
+                if (connect(control_fd, (struct sockaddr *) &addr,
+                            sizeof(struct sockaddr_un)) == 0)
+                        return 0;
+                close(control_fd);
+                control_fd = -1;
+                sleep_for(0.05);
+        }
+        fprintf(stderr, "connect %s: timed out\n", PATH_CONTROL_SOCKET);
+        return -1;
+}
+
+/* Sends request to the control socket and stores the result lines,
+   following the status line, into result. */
+static int control_request(const char *request, char *result,
+                           size_t result_size)
+{
+        char reply[CONTROL_MESSAGE_MAX];
+        ssize_t bytes;
+        char *lines;
+
+        if (send(control_fd, request, strlen(request), MSG_NOSIGNAL)
+            == -1) {
+                fprintf(stderr, "%s: %s\n", request, strerror(errno));
+                return -1;
+        }
+        if ((bytes = recv(control_fd, reply, sizeof(reply) - 1, 0)) <= 0) {
+                fprintf(stderr, "%s: %s\n", request, bytes
+                        ? strerror(errno) : "connection closed");
+                return -1;
+        }
+        reply[bytes] = '\0';
+
+        if (strncmp(reply, "ok", 2) != 0) {
+                fprintf(stderr, "%s: %s\n", request, reply);
+                return -1;
+        }
+        lines = strchr(reply, '\n');
+        snprintf(result, result_size, "%s", lines ? lines + 1 : "");
+        return 0;
+}
+
+static int read_sample(struct sample *sample)
+{
+        char result[CONTROL_MESSAGE_MAX];
+        char name[64];
+        double value;
+        char *line;
+
+        if (control_request("stats", result, sizeof(result)) == -1)
+                return -1;
+
+        memset(sample, 0, sizeof(struct sample));
+        for (line = strtok(result, "\n"); line; line = strtok(NULL, "\n")) {
+                if (sscanf(line, "%63s %lf", name, &value) != 2)
+                        continue;
+                if (strcmp(name, "resident_kb") == 0)
+                        sample->resident_kb = value;
+                else if (strcmp(name, "fds") == 0)
+                        sample->fds = value;
+                else if (strcmp(name, "cpu_us_per_event") == 0)
+                        sample->cpu_us_per_event = value;
+                else if (strcmp(name, "latency_us_mean") == 0)
+                        sample->latency_us_mean = value;
+        }
+        return 0;
+}
+
+/* Fails if sample has grown beyond the thresholds over base. Latency and
+   CPU time are allowed to grow by max_slowdown, but at least by a small
+   absolute amount, so that a fast baseline does not fail on noise. */
+static int check_sample(const struct sample *base,
+                        const struct sample *sample, double elapsed)
+{
+        double max_latency;
+        double max_cpu;
+        int    is_ok = 1;
+
+        max_latency = base->latency_us_mean * max_slowdown;
+        if (max_latency < base->latency_us_mean + 1000.0)
+                max_latency = base->latency_us_mean + 1000.0;
+        max_cpu = base->cpu_us_per_event * max_slowdown;
+        if (max_cpu < base->cpu_us_per_event + 50.0)
+                max_cpu = base->cpu_us_per_event + 50.0;
+
+        if (sample->resident_kb > base->resident_kb
+            + max_resident_growth_kb) {
+                fprintf(stderr, "%.0f s: resident memory %.0f kB, "
+                        "baseline %.0f kB\n", elapsed, sample->resident_kb,
+                        base->resident_kb);
+                is_ok = 0;
+        }
+        if (sample->fds > base->fds + max_fds_growth) {
+                fprintf(stderr, "%.0f s: %.0f open fds, baseline %.0f\n",
+                        elapsed, sample->fds, base->fds);
+                is_ok = 0;
+        }
+        if (sample->latency_us_mean > max_latency) {
+                fprintf(stderr, "%.0f s: mean latency %.0f us, "
+                        "baseline %.0f us\n", elapsed,
+                        sample->latency_us_mean, base->latency_us_mean);
+                is_ok = 0;
+        }
+        if (sample->cpu_us_per_event > max_cpu) {
+                fprintf(stderr, "%.0f s: %.1f us CPU per event, "
+                        "baseline %.1f us\n", elapsed,
+                        sample->cpu_us_per_event, base->cpu_us_per_event);
+                is_ok = 0;
+        }
+        return is_ok ? 0 : -1;
+}
+
+/* Stops evdaemon while both devices are flooded, so that their evdev
+   buffers overflow and evdaemon reads SYN_DROPPED when it continues. */
+static int inject_flood(void)
+{
+        int stop_i;
+        int frame_i;
+
+        for (stop_i = 0; stop_i < FLOOD_STOPC; ++stop_i) {
+                if (kill(evdaemon_pid, SIGSTOP) == -1) {
+                        perror("kill SIGSTOP");
+                        return -1;
+                }
+                for (frame_i = 0; frame_i < FLOOD_FRAMEC; ++frame_i) {
+                        if (emit_motion(frame_i, 0) == -1
+                            || emit_key(frame_i % 2) == -1) {
+                                kill(evdaemon_pid, SIGCONT);
+                                return -1;
+                        }
+                }
+                /* A key left down would suppress the rest of the run. */
+                if (emit_key(0) == -1
+                    || kill(evdaemon_pid, SIGCONT) == -1) {
+                        kill(evdaemon_pid, SIGCONT);
+                        return -1;
+                }
+                sleep_for(0.01);
+        }
+        return 0;
+}
+
+/* Removes the monitor device between the events of a frame and creates
+   it again, evdaemon has to notice it coming back. */
+static int inject_monitor_removal(void)
+{
+        if (emit(monitor_fd, EV_KEY, KEY_A, 1) == -1)
+                return -1;
+        destroy_standin(&monitor_fd);
+        sleep_for(MONITOR_GONE_TIME);
+        if ((monitor_fd = create_standin(MONITOR_NAME, 0)) == -1) {
+                perror("create monitor stand-in");
+                return -1;
+        }
+        return 0;
+}
+
+/* Rewrites the configuration with the control socket, changes which
+   evdaemon applies without a restart. */
+static int inject_config_rewrite(int rewrite_i)
+{
+        char result[CONTROL_MESSAGE_MAX];
+
+        if (control_request(rewrite_i % 2 ? "set filter/duration 0.5"
+                            : "set filter/duration 0.25",
+                            result, sizeof(result)) == -1)
+                return -1;
+        return control_request(rewrite_i % 2
+                               ? "set monitor/capabilities/key "
+                               "7fffffffffffffe"
+                               : "set monitor/capabilities/key "
+                               "7ffffffffff0000",
+                               result, sizeof(result));
+}
+
+static int test_startup_sigterm(void)
+{
+        int kill_i;
+
+        for (kill_i = 0; kill_i < STARTUP_KILLC; ++kill_i) {
+                if (start_evdaemon() == -1)
+                        return -1;
+                sleep_for(kill_i / 1000.0);
+                if (stop_evdaemon() == -1) {
+                        fprintf(stderr, "SIGTERM after %d ms of startup\n",
+                                kill_i);
+                        return -1;
+                }
+        }
+        printf("startup: %d SIGTERMs survived\n", STARTUP_KILLC);
+        return 0;
+}
+
+static int test_soak(void)
+{
+        struct sample base;
+        struct sample sample;
+        double start;
+        double elapsed;
+        double next_frame;
+        double next_sample;
+        double next_key;
+        double next_click;
+        double next_fault;
+        double warmup;
+        int    is_base = 0;
+        int    fault_i = 0;
+        int    frame_i = 0;
+        int    key_value = 0;
+
+        memset(&base, 0, sizeof(struct sample));
+        memset(&sample, 0, sizeof(struct sample));
+        if (start_evdaemon() == -1 || connect_control() == -1)
+                return -1;
+
+        warmup = duration / 10.0 < 10.0 ? duration / 10.0 : 10.0;
+        start = now();
+        next_frame = next_key = next_click = start;
+        next_sample = start + warmup;
+        next_fault = start + warmup + FAULT_INTERVAL;
+
+        while ((elapsed = now() - start) < duration) {
+                int is_peak = (int) (elapsed / RATE_INTERVAL) % 2;
+                int is_click = 0;
+
+                if (waitpid(evdaemon_pid, NULL, WNOHANG) != 0) {
+                        fprintf(stderr, "%.0f s: evdaemon died\n", elapsed);
+                        evdaemon_pid = -1;
+                        return -1;
+                }
+
+                if (now() >= next_click) {
+                        is_click = 1;
+                        next_click += CLICK_INTERVAL;
+                }
+                if (emit_motion(frame_i++, is_click) == -1)
+                        return -1;
+                if (now() >= next_key) {
+                        key_value = !key_value;
+                        if (emit_key(key_value) == -1)
+                                return -1;
+                        next_key += KEY_INTERVAL;
+                }
+
+                if (now() >= next_fault) {
+                        int retval;
+
+                        switch (fault_i % 3) {
+                        case 0:
+                                retval = inject_monitor_removal();
+                                break;
+                        case 1:
+                                retval = inject_flood();
+                                break;
+                        default:
+                                retval = inject_config_rewrite(fault_i);
+                                break;
+                        }
+                        if (retval == -1) {
+                                fprintf(stderr, "%.0f s: fault %d failed\n",
+                                        elapsed, fault_i % 3);
+                                return -1;
+                        }
+                        ++fault_i;
+                        next_fault += FAULT_INTERVAL;
+                        /* Do not make up for the time the fault took. */
+                        next_frame = next_key = next_click = now();
+                }
+
+                if (now() >= next_sample) {
+                        if (read_sample(&sample) == -1)
+                                return -1;
+                        if (!is_base) {
+                                base = sample;
+                                is_base = 1;
+                        } else if (check_sample(&base, &sample,
+                                                elapsed) == -1) {
+                                return -1;
+                        }
+                        next_sample += 1.0;
+                }
+
+                next_frame += 1.0 / (is_peak ? peak_rate : realistic_rate);
+                sleep_for(next_frame - now());
+        }
+        if (emit_key(0) == -1)
+                return -1;
+
+        printf("soak: %.0f s, %d faults, resident %.0f kB, %.0f fds, "
+               "%.0f us mean latency, %.1f us CPU per event\n",
+               duration, fault_i, sample.resident_kb, sample.fds,
+               sample.latency_us_mean, sample.cpu_us_per_event);
+        return 0;
+}
+
+static int test_filter_removal(void)
+{
+        if (emit(filter_fd, EV_KEY, BTN_LEFT, 1) == -1)
+                return -1;
+        destroy_standin(&filter_fd);
+        if (wait_exit(EXIT_TIMEOUT, 0) == -1) {
+                fprintf(stderr, "filter device removed mid-frame\n");
+                return -1;
+        }
+        printf("filter removal: evdaemon exited cleanly\n");
+        return 0;
+}
+
+static void usage_and_exit(void)
+{
+        fprintf(stderr, "Usage: test-soak [-t SECONDS] [-r RATE] "
+                "[-R PEAK_RATE] [-m KB] [-f FDS] [-s FACTOR] EVDAEMON\n");
+        exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+        int exitval = EXIT_FAILURE;
+        int option;
+
+        while ((option = getopt(argc, argv, "t:r:R:m:f:s:")) != -1) {
+                switch (option) {
+                case 't':
+                        duration = atof(optarg);
+                        break;
+                case 'r':
+                        realistic_rate = atof(optarg);
+                        break;
+                case 'R':
+                        peak_rate = atof(optarg);
+                        break;
+                case 'm':
+                        max_resident_growth_kb = atof(optarg);
+                        break;
+                case 'f':
+                        max_fds_growth = atof(optarg);
+                        break;
+                case 's':
+                        max_slowdown = atof(optarg);
+                        break;
+                default:
+                        usage_and_exit();
+                }
+        }
+        if (optind != argc - 1 || duration <= 0.0 || realistic_rate <= 0.0
+            || peak_rate <= 0.0)
+                usage_and_exit();
+        evdaemon_path = argv[optind];
+
+        if ((filter_fd = create_standin(FILTER_NAME, 1)) == -1
+            || (monitor_fd = create_standin(MONITOR_NAME, 0)) == -1) {
+                perror("create stand-in device with uinput");
+                goto out;
+        }
+        if (write_config() == -1)
+                goto out;
+
+        if (test_startup_sigterm() == -1 || test_soak() == -1)
+                goto out;
+        if (control_fd != -1) {
+                close(control_fd);
+                control_fd = -1;
+        }
+        if (test_filter_removal() == -1)
+                goto out;
+
+        exitval = EXIT_SUCCESS;
+out:
+        if (control_fd != -1)
+                close(control_fd);
+        if (evdaemon_pid != -1) {
+                kill(evdaemon_pid, SIGCONT);
+                kill(evdaemon_pid, SIGTERM);
+                waitpid(evdaemon_pid, NULL, 0);
+        }
+        destroy_standin(&filter_fd);
+        destroy_standin(&monitor_fd);
+        if (is_config_written)
+                unlink(PATH_CONFIG_FILE);
+        return exitval;
+}
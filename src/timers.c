@@ -0,0 +1,218 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "timers.h"
+#include "util.h"
+
+static struct timer *heapv[TIMERS_MAX];
+static int           heapc = 0;
+static int           timer_fd = -1;
+static clockid_t     timer_clock = CLOCK_REALTIME;
+static double        programmed = 0; /* Deadline the timerfd is set to. */
+
+static void place(struct timer *timer, int heap_i)
+{
+        heapv[heap_i] = timer;
+        timer->heap_i = heap_i;
+}
+
+static void sift_up(int heap_i)
+{
+        struct timer *timer = heapv[heap_i];
+
+        while (heap_i > 0) {
+                int parent_i = (heap_i - 1) / 2;
+
+                if (heapv[parent_i]->deadline <= timer->deadline)
+                        break;
+                place(heapv[parent_i], heap_i);
+                heap_i = parent_i;
+        }
+        place(timer, heap_i);
+}
+
+static void sift_down(int heap_i)
+{
+        struct timer *timer = heapv[heap_i];
+
+        while (1) {
+                int child_i = heap_i * 2 + 1;
+
+                if (child_i >= heapc)
+                        break;
+                if (child_i + 1 < heapc
+                    && heapv[child_i + 1]->deadline
+                    < heapv[child_i]->deadline)
+                        ++child_i;
+                if (timer->deadline <= heapv[child_i]->deadline)
+                        break;
+                place(heapv[child_i], heap_i);
+                heap_i = child_i;
+        }
+        place(timer, heap_i);
+}
+
+void timer_init(struct timer *timer,
+                void (*expire)(struct timer *timer,
+                               const struct timeval *now))
+{
+        timer->deadline = 0;
+        timer->heap_i = -1;
+        timer->expire = expire;
+}
+
+int timers_open(clockid_t clock_id)
+{
+        if ((timer_fd = timerfd_create(clock_id,
+                                       TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+                return -1;
+        timer_clock = clock_id;
+        heapc = 0;
+        programmed = 0;
+        return 0;
+}
+
+void timers_close(void)
+{
+        if (timer_fd != -1)
+                close(timer_fd);
+        timer_fd = -1;
+        heapc = 0;
+}
+
+int timers_fd(void)
+{
+        return timer_fd;
+}
+
+/* Arms timer to expire at deadline, or moves it if it is armed already.
+   Takes effect on the next timers_update().
+
+   Returns
+
+   0 : The timer was armed.
+
+   -1 : There are TIMERS_MAX timers armed already, errno is set.
+*/
+int timers_arm(struct timer *timer, double deadline)
+{
+        double old_deadline = timer->deadline;
+
+        timer->deadline = deadline;
+
+        if (!timer_is_armed(timer)) {
+                if (heapc == TIMERS_MAX) {
+                        errno = ENOSPC;
+                        return -1;
+                }
+                place(timer, heapc++);
+                sift_up(timer->heap_i);
+        } else if (deadline < old_deadline) {
+                sift_up(timer->heap_i);
+        } else if (deadline > old_deadline) {
+                sift_down(timer->heap_i);
+        }
+        return 0;
+}
+
+/* Disarms timer. Does nothing if the timer is not armed. */
+void timers_cancel(struct timer *timer)
+{
+        int           heap_i = timer->heap_i;
+        struct timer *last;
+
+        if (!timer_is_armed(timer))
+                return;
+
+        timer->heap_i = -1;
+        last = heapv[--heapc];
+        if (heap_i == heapc)
+                return;
+
+        place(last, heap_i);
+        if (heap_i > 0 && heapv[(heap_i - 1) / 2]->deadline > last->deadline)
+                sift_up(heap_i);
+        else
+                sift_down(heap_i);
+}
+
+/* Programs the timerfd to the nearest deadline, if it has changed since
+   the previous call. Called once per round of the event loop, so that
+   arming and cancelling timers costs no syscalls. */
+int timers_update(void)
+{
+        struct itimerspec spec;
+        double            deadline = heapc ? heapv[0]->deadline : 0;
+
+        if (deadline == programmed)
+                return 0;
+
+        memset(&spec, 0, sizeof(spec));
+        if (deadline) {
+                spec.it_value.tv_sec = (time_t) deadline;
+                spec.it_value.tv_nsec = (long) ((deadline
+                                                 - spec.it_value.tv_sec)
+                                                * 1000000000.0);
+                /* Zero would disarm the timerfd. */
+                if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec)
+                        spec.it_value.tv_nsec = 1;
+        }
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1)
+                return -1;
+        programmed = deadline;
+        return 0;
+}
+
+/* Called when the timerfd is readable. Expires every timer whose
+   deadline has passed, in deadline order. Expire callbacks may arm and
+   cancel timers, including the expiring one.
+
+   Returns
+
+   >=0 : Number of timers expired.
+
+   -1 : Syscall failed and errno is set.
+*/
+int timers_expire(void)
+{
+        struct timeval now;
+        uint64_t       expirationc;
+        int            expiredc = 0;
+
+        if (read(timer_fd, &expirationc, sizeof(expirationc)) == -1
+            && errno != EAGAIN)
+                return -1;
+        /* The timerfd has fired and is not armed anymore. */
+        programmed = 0;
+
+        if (clock_gettimeval(timer_clock, &now) == -1)
+                return -1;
+
+        while (heapc && heapv[0]->deadline <= timestamp(&now)) {
+                struct timer *timer = heapv[0];
+
+                timers_cancel(timer);
+                timer->expire(timer, &now);
+                ++expiredc;
+        }
+        return expiredc;
+}
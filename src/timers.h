@@ -0,0 +1,60 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <time.h>
+#include <sys/time.h>
+
+/* Deadlines of the event path, kept in a min-heap. A single timerfd is
+   programmed to the nearest deadline, so the event loop wakes up exactly
+   when something expires and never polls. Deadlines are timestamps of
+   the clock given to timers_open(), the same clock the event devices
+   timestamp their events with. */
+
+#define TIMERS_MAX 24
+
+struct timer {
+        double deadline;
+        int    heap_i; /* -1 if the timer is not armed. */
+        void (*expire)(struct timer *timer, const struct timeval *now);
+};
+
+void timer_init(struct timer *timer,
+                void (*expire)(struct timer *timer,
+                               const struct timeval *now));
+
+static inline int timer_is_armed(const struct timer *timer)
+{
+        return timer->heap_i != -1;
+}
+
+int timers_open(clockid_t clock_id);
+
+void timers_close(void);
+
+int timers_fd(void);
+
+int timers_arm(struct timer *timer, double deadline);
+
+void timers_cancel(struct timer *timer);
+
+int timers_update(void);
+
+int timers_expire(void);
+
+#endif /* TIMERS_H */
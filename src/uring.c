@@ -0,0 +1,179 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <liburing.h>
+
+#include "uring.h"
+
+static struct io_uring ring;
+static int             is_open = 0;
+
+/* Returns
+
+   0 : The ring was set up.
+
+   -1 : io_uring is not available (old kernel, seccomp, ...) and errno is
+   set. The caller is expected to fall back to select.
+*/
+int uring_open(unsigned entries)
+{
+        int retval;
+
+        if ((retval = io_uring_queue_init(entries, &ring, 0)) < 0) {
+                errno = -retval;
+                return -1;
+        }
+        is_open = 1;
+        return 0;
+}
+
+void uring_close(void)
+{
+        if (!is_open)
+                return;
+        io_uring_queue_exit(&ring);
+        is_open = 0;
+}
+
+static struct io_uring_sqe *get_sqe(void)
+{
+        struct io_uring_sqe *sqe;
+
+        if ((sqe = io_uring_get_sqe(&ring)) != NULL)
+                return sqe;
+
+        /* Submission queue is full, flush it and try once more. */
+        if (io_uring_submit(&ring) < 0)
+                return NULL;
+        if ((sqe = io_uring_get_sqe(&ring)) == NULL)
+                errno = EBUSY;
+        return sqe;
+}
+
+/* Queues a read. The read is not submitted until uring_wait() is
+   called, which lets several reads and writes share one syscall. If link
+   is non-zero, the next queued operation starts only after this one has
+   completed. */
+int uring_prep_read(int fd, void *buf, size_t size, uintptr_t tag, int link)
+{
+        struct io_uring_sqe *sqe;
+
+        if ((sqe = get_sqe()) == NULL)
+                return -1;
+        io_uring_prep_read(sqe, fd, buf, size, 0);
+        io_uring_sqe_set_data(sqe, (void *) tag);
+        if (link)
+                sqe->flags |= IOSQE_IO_LINK;
+        return 0;
+}
+
+int uring_prep_write(int fd, const void *buf, size_t size, uintptr_t tag,
+                     int link)
+{
+        struct io_uring_sqe *sqe;
+
+        if ((sqe = get_sqe()) == NULL)
+                return -1;
+        io_uring_prep_write(sqe, fd, buf, size, 0);
+        io_uring_sqe_set_data(sqe, (void *) tag);
+        if (link)
+                sqe->flags |= IOSQE_IO_LINK;
+        return 0;
+}
+
+/* Queues a one-shot poll for readability of fd. */
+int uring_prep_poll(int fd, uintptr_t tag)
+{
+        struct io_uring_sqe *sqe;
+
+        if ((sqe = get_sqe()) == NULL)
+                return -1;
+        io_uring_prep_poll_add(sqe, fd, POLLIN);
+        io_uring_sqe_set_data(sqe, (void *) tag);
+        return 0;
+}
+
+/* Queues a one-shot poll for writability of fd. */
+int uring_prep_poll_out(int fd, uintptr_t tag)
+{
+        struct io_uring_sqe *sqe;
+
+        if ((sqe = get_sqe()) == NULL)
+                return -1;
+        io_uring_prep_poll_add(sqe, fd, POLLOUT);
+        io_uring_sqe_set_data(sqe, (void *) tag);
+        return 0;
+}
+
+/* Submits all queued operations and waits at most timeout, or forever if
+   timeout is NULL, for at least one completion. Every available
+   completion is passed to handler, which may queue new operations.
+
+   Returns
+
+   >0 : Number of completions handled.
+
+   0 : Timed out or interrupted by a signal.
+
+   -1 : Syscall failed and errno is set.
+
+   -2 : Handler returned -1.
+*/
+int uring_wait(const struct timespec *timeout, const sigset_t *sigmask,
+               int (*handler)(uintptr_t tag, int res))
+{
+        struct __kernel_timespec ts;
+        struct io_uring_cqe     *cqe;
+        unsigned                 head;
+        int                      cqec = 0;
+        int                      retval;
+
+        if (timeout != NULL) {
+                ts.tv_sec = timeout->tv_sec;
+                ts.tv_nsec = timeout->tv_nsec;
+        }
+
+        retval = io_uring_submit_and_wait_timeout(&ring, &cqe, 1,
+                                                  timeout ? &ts : NULL,
+                                                  (sigset_t *) sigmask);
+        switch (retval) {
+        case -ETIME:
+        case -EINTR:
+                return 0;
+        default:
+                if (retval < 0) {
+                        errno = -retval;
+                        return -1;
+                }
+                break;
+        }
+
+        io_uring_for_each_cqe(&ring, head, cqe) {
+                uintptr_t tag = (uintptr_t) io_uring_cqe_get_data(cqe);
+                int       res = cqe->res;
+
+                ++cqec;
+                if (handler(tag, res) == -1) {
+                        io_uring_cq_advance(&ring, cqec);
+                        return -2;
+                }
+        }
+        io_uring_cq_advance(&ring, cqec);
+        return cqec;
+}
@@ -0,0 +1,40 @@
+/*
+  Copyright © 2011 Tuomas Jorma Juhani Räsänen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef URING_H
+#define URING_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+
+int uring_open(unsigned entries);
+
+void uring_close(void);
+
+int uring_prep_read(int fd, void *buf, size_t size, uintptr_t tag, int link);
+
+int uring_prep_write(int fd, const void *buf, size_t size, uintptr_t tag,
+                     int link);
+
+int uring_prep_poll(int fd, uintptr_t tag);
+
+int uring_prep_poll_out(int fd, uintptr_t tag);
+
+int uring_wait(const struct timespec *timeout, const sigset_t *sigmask,
+               int (*handler)(uintptr_t tag, int res));
+
+#endif /* URING_H */
@@ -15,7 +15,6 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <linux/uinput.h>
-#include <libudev.h>
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
@@ -23,11 +22,20 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <dirent.h>
 #include <glob.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 
+#include "config.h"
+#include "feedback.h"
+#include "remap.h"
 #include "util.h"
 
+#ifdef HAVE_LIBUDEV
+#include <libudev.h>
+#endif
+
 /*
   Returns:
    0: success
@@ -39,9 +47,14 @@ int strtovaluev(uint64_t *valuev, size_t len, const char *line)
 {
         const char *nptr = line;
         char *endptr;
+        uint64_t tmp_valuev[len];
         size_t valuec = 0;
-        int i;
+        size_t i;
 
+        /* Values are parsed in a single pass into a temporary array,
+           most significant first, and reversed into valuev only if the
+           whole line was valid. Words the line does not give are
+           cleared, valuev may hold a previous value. */
         do {
                 uint64_t value;
                 errno = 0;
@@ -50,22 +63,20 @@ int strtovaluev(uint64_t *valuev, size_t len, const char *line)
                         return -2;
                 if (errno)
                         return -1;
-                ++valuec;
+                if (valuec == len)
+                        return -3;
+                tmp_valuev[valuec++] = value;
                 nptr = endptr;
         } while (*endptr != '\0');
 
-        if (valuec > len)
-                return -3;
-
-        nptr = line;
-        for (i = valuec - 1; i >= 0; --i) {
-                valuev[i] = strtoull(nptr, &endptr, 16);
-                nptr = endptr;
-        }
+        for (i = 0; i < valuec; ++i)
+                valuev[i] = tmp_valuev[valuec - 1 - i];
+        for (; i < len; ++i)
+                valuev[i] = 0;
         return 0;
 }
 
-static int open_matching(const char *path, const char *name)
+static int open_matching(const char *path, const char *name, int flags)
 {
         int cmp_result = -2;
         int fd = -1;
@@ -77,7 +88,11 @@ static int open_matching(const char *path, const char *name)
         if (other_name == NULL)
                 return -1;
 
-        if ((fd = open(path, O_RDONLY)) == -1)
+        /* A device asked to be writable is still opened for reading if
+           writing is not permitted, it then just gets no feedback. */
+        if ((fd = open(path, flags)) == -1
+            && (flags == O_RDONLY || errno != EACCES
+                || (fd = open(path, O_RDONLY)) == -1))
                 goto out;
 
         if (ioctl(fd, EVIOCGNAME(name_size - 1), other_name) == -1)
@@ -96,7 +111,7 @@ out:
         return fd;
 }
 
-int open_evdev_by_name(const char *name)
+int open_evdev_by_name(const char *name, int flags)
 {
         int i;
         glob_t g;
@@ -126,7 +141,7 @@ int open_evdev_by_name(const char *name)
         }
 
         for (i = 0; i < g.gl_pathc; ++i) {
-                if ((fd = open_matching(g.gl_pathv[i], name)) != -1)
+                if ((fd = open_matching(g.gl_pathv[i], name, flags)) != -1)
                         break;
         }
 out:
@@ -186,6 +201,117 @@ double timestamp(const struct timeval *tv)
         return tv->tv_sec + (tv->tv_usec / 1000000.0);
 }
 
+/* Like gettimeofday(2), but reads clock_id, so that the time can be
+   compared with event timestamps of devices set to the same clock. */
+int clock_gettimeval(clockid_t clock_id, struct timeval *tv)
+{
+        struct timespec ts;
+
+        if (clock_gettime(clock_id, &ts) == -1)
+                return -1;
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+        return 0;
+}
+
+/* Makes the event device timestamp its events with clock_id. */
+int set_evdev_clock(int evdev_fd, clockid_t clock_id)
+{
+        int clk = clock_id;
+
+        return ioctl(evdev_fd, EVIOCSCLOCKID, &clk);
+}
+
+/* Returns non-zero if code reports the contact or tool of a touchpad,
+   touchscreen or tablet rather than a pressed key or button. */
+static int is_contact_code(int code)
+{
+        switch (code) {
+        case BTN_TOUCH:
+        case BTN_TOOL_PEN:
+        case BTN_TOOL_RUBBER:
+        case BTN_TOOL_BRUSH:
+        case BTN_TOOL_PENCIL:
+        case BTN_TOOL_AIRBRUSH:
+        case BTN_TOOL_FINGER:
+        case BTN_TOOL_MOUSE:
+        case BTN_TOOL_LENS:
+        case BTN_TOOL_QUINTTAP:
+        case BTN_TOOL_DOUBLETAP:
+        case BTN_TOOL_TRIPLETAP:
+        case BTN_TOOL_QUADTAP:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+/* Returns the number of keys and buttons of the event device which are
+   held down, or -1 on error. Touch and tool codes are not counted: a
+   resting palm keeps them down for as long as it rests. */
+int count_evdev_keys_down(int evdev_fd)
+{
+        uint8_t keyv[KEY_MAX / 8 + 1];
+        int     keyc = 0;
+        int     i;
+
+        memset(keyv, 0, sizeof(keyv));
+        if (ioctl(evdev_fd, EVIOCGKEY(sizeof(keyv)), keyv) == -1)
+                return -1;
+        for (i = 0; i <= KEY_MAX; ++i) {
+                if (!is_contact_code(i))
+                        keyc += bit_test8(i, keyv);
+        }
+        return keyc;
+}
+
+/* Returns the resident memory of the process in kB, or -1 and sets
+   errno. */
+long get_resident_kb(void)
+{
+        char    buf[128];
+        long    pagec;
+        ssize_t bytes;
+        int     orig_errno;
+        int     fd;
+
+        if ((fd = open("/proc/self/statm", O_RDONLY)) == -1)
+                return -1;
+        bytes = read(fd, buf, sizeof(buf) - 1);
+        orig_errno = errno;
+        close(fd);
+        errno = orig_errno;
+        if (bytes == -1)
+                return -1;
+        buf[bytes] = '\0';
+
+        if (sscanf(buf, "%*d %ld", &pagec) != 1) {
+                errno = EINVAL;
+                return -1;
+        }
+        return pagec * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Returns the number of open file descriptors of the process, or -1
+   and sets errno. */
+int count_open_fds(void)
+{
+        DIR           *dir;
+        struct dirent *entry;
+        int            fdc = 0;
+
+        if ((dir = opendir("/proc/self/fd")) == NULL)
+                return -1;
+        while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] != '.')
+                        ++fdc;
+        }
+        closedir(dir);
+        /* Not counting the one of dir itself. */
+        return fdc - 1;
+}
+
+#ifdef HAVE_LIBUDEV
 const char *get_devroot_path()
 {
         static char dev_path[_POSIX_PATH_MAX + 1];
@@ -249,9 +375,78 @@ out:
         errno = orig_errno;
         return retval;
 }
+#else /* HAVE_LIBUDEV */
+/* Without udev, device nodes are the ones devtmpfs makes as the kernel
+   names them, and hotplugged event devices appear there too. */
+const char *get_devroot_path()
+{
+        return "/dev";
+}
+
+/* Reads the name of the uinput node from the uevent attribute the
+   kernel exports in sysfs. Nothing is allocated. */
+const char *get_uinput_devnode()
+{
+        static char uinput_devnode[_POSIX_PATH_MAX + 1];
+        const char  devname[] = "DEVNAME=";
+        char        buf[512];
+        char       *line;
+        char       *next;
+        ssize_t     bytes;
+        int         orig_errno;
+        int         fd;
+
+        if ((fd = open("/sys/class/misc/uinput/uevent", O_RDONLY)) == -1)
+                return NULL;
+        bytes = read(fd, buf, sizeof(buf) - 1);
+        orig_errno = errno;
+        close(fd);
+        errno = orig_errno;
+        if (bytes == -1)
+                return NULL;
+        buf[bytes] = '\0';
+
+        for (line = buf; line != NULL; line = next) {
+                if ((next = strchr(line, '\n')) != NULL)
+                        *next++ = '\0';
+                if (strncmp(line, devname, sizeof(devname) - 1))
+                        continue;
+                if (snprintf(uinput_devnode, sizeof(uinput_devnode), "%s/%s",
+                             get_devroot_path(),
+                             line + sizeof(devname) - 1)
+                    >= sizeof(uinput_devnode)) {
+                        errno = ENAMETOOLONG;
+                        return NULL;
+                }
+                return uinput_devnode;
+        }
+        errno = ENOENT;
+        return NULL;
+}
+#endif /* HAVE_LIBUDEV */
+
+/* Advertises code of type evtype on the clone, or the code it is
+   translated into if remap is not NULL. */
+static int set_clone_bit(int clone_fd, int evtype, int io, int code,
+                         const struct remap *remap)
+{
+        const struct remap_code *to = NULL;
+
+        if (remap != NULL)
+                to = remap_lookup(remap, evtype, code);
+
+        if (to == NULL || !to->type)
+                return ioctl(clone_fd, io, code);
+
+        if (ioctl(clone_fd, UI_SET_EVBIT, to->type) == -1)
+                return -1;
+        return ioctl(clone_fd,
+                     to->type == EV_KEY ? UI_SET_KEYBIT : UI_SET_RELBIT,
+                     to->code);
+}
 
 int clone_evdev(int evdev_fd, const struct input_id *clone_id,
-                const char *clone_name)
+                const char *clone_name, const struct remap *remap)
 {
         struct uinput_user_dev user_dev;
         struct input_id id;
@@ -274,7 +469,7 @@ int clone_evdev(int evdev_fd, const struct input_id *clone_id,
         if ((uinput_devnode = get_uinput_devnode()) == NULL)
                 return -1;
 
-        if ((clone_fd = open(uinput_devnode, O_WRONLY)) == -1)
+        if ((clone_fd = open(uinput_devnode, O_RDWR | O_NONBLOCK)) == -1)
                 return -1;
 
         /* From now on, resources has to released:
@@ -334,7 +529,9 @@ int clone_evdev(int evdev_fd, const struct input_id *clone_id,
                                 }
                                 for (i = 0; i < max_bit; ++i) {
                                         if (bit_test8(i, evbits)
-                                            && ioctl(clone_fd, io, i) == -1) {
+                                            && set_clone_bit(clone_fd, evtype,
+                                                             io, i,
+                                                             remap) == -1) {
                                                 goto out;
                                         }
                                 }
@@ -349,6 +546,17 @@ int clone_evdev(int evdev_fd, const struct input_id *clone_id,
         user_dev.id.product = clone_id->product;
         user_dev.id.version = clone_id->version;
 
+        /* uinput refuses force feedback without room for effects. */
+        if (bit_test8(EV_FF, evdev_typebits)) {
+                int effectc;
+
+                if (ioctl(evdev_fd, EVIOCGEFFECTS, &effectc) == -1)
+                        goto out;
+                if (effectc > FEEDBACK_EFFECTS_MAX)
+                        effectc = FEEDBACK_EFFECTS_MAX;
+                user_dev.ff_effects_max = effectc;
+        }
+
         if (write(clone_fd, &user_dev, sizeof(struct uinput_user_dev))
             != sizeof(struct uinput_user_dev))
                 goto out;
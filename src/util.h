@@ -18,11 +18,12 @@
 #define UTIL_H
 
 #include <stdint.h>
+#include <time.h>
 #include <sys/time.h>
 
 int strtovaluev(uint64_t *valuev, size_t len, const char *line);
 
-int open_evdev_by_name(const char *name);
+int open_evdev_by_name(const char *name, int flags);
 
 int readln(char **buf, size_t *n, const char *path);
 
@@ -32,10 +33,23 @@ int bit_test8(int bit_i, const uint8_t *bytes);
 
 double timestamp(const struct timeval *tv);
 
+int clock_gettimeval(clockid_t clock_id, struct timeval *tv);
+
+int set_evdev_clock(int evdev_fd, clockid_t clock_id);
+
+int count_evdev_keys_down(int evdev_fd);
+
+long get_resident_kb(void);
+
+int count_open_fds(void);
+
 const char *get_uinput_devnode();
 
+struct input_id;
+struct remap;
+
 int clone_evdev(int evdev_fd, const struct input_id *clone_id,
-                const char *clone_name);
+                const char *clone_name, const struct remap *remap);
 
 const char *get_devroot_path();
 